@@ -0,0 +1,358 @@
+#!/usr/bin/env python3
+
+"""The script decompiles many files via RetDec IDA plugin, running several
+IDA console processes in parallel.
+
+Files to decompile are listed in a manifest, one per line. A line is either
+a path to the input file, or a JSON object with the following keys:
+   file   - the input file (required).
+   output - output file (default: file.c in the output directory).
+   idb    - IDA DB file associated with the input file.
+   select - list of addresses (any address inside function). Only these
+            functions are decompiled, all of them in a single decompiler run.
+Empty lines and lines starting with '#' are ignored. Relative paths are
+relative to the manifest's directory.
+
+Each file is decompiled by a single decompiler run in the plugin's worker
+process (retdec-idaplugin-worker), which enforces the time and memory limits.
+
+A summary with the status, time, and attempts of each file is written into
+a JSON file.
+"""
+
+import argparse
+import concurrent.futures
+import json
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import threading
+import time
+
+
+script_full = 'retdec-decompile-full.idc'
+script_batch = 'retdec-decompile-batch.idc'
+
+
+def is_windows():
+    return sys.platform in ('win32', 'msys') or os.name == 'nt'
+
+
+def print_error_and_die(*msg):
+    print('Error:', *msg)
+    sys.exit(1)
+
+
+def parse_args(args):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+
+    parser.add_argument('manifest',
+                        metavar='MANIFEST',
+                        help='File with the list of input files.')
+
+    parser.add_argument('-o', '--output-dir',
+                        dest='output_dir',
+                        metavar='DIR',
+                        default='.',
+                        help='Directory for the outputs, the summary, and the working directories of the jobs (default: current directory).')
+
+    parser.add_argument('-i', '--ida',
+                        dest='ida_dir',
+                        default=os.environ.get('IDA_DIR'),
+                        help='Path to the IDA directory.')
+
+    parser.add_argument('-j', '--jobs',
+                        dest='jobs',
+                        type=int,
+                        default=max(1, (os.cpu_count() or 2) // 2),
+                        help='Number of IDA processes running in parallel (default: half of the CPU cores).')
+
+    parser.add_argument('-t', '--timeout',
+                        dest='timeout',
+                        type=int,
+                        default=0,
+                        help='Time limit of one decompilation in seconds, 0 = no limit (default: 0). '
+                             'The worker process running out of time is killed, and so is IDA if it does not finish in twice the time.')
+
+    parser.add_argument('-m', '--max-memory',
+                        dest='max_memory',
+                        type=int,
+                        default=0,
+                        help='Memory limit of one decompilation in MB, 0 = half of the system memory (default: 0). '
+                             'It is enforced on the worker process, not on IDA.')
+
+    parser.add_argument('-r', '--retries',
+                        dest='retries',
+                        type=int,
+                        default=1,
+                        help='Number of retries of a failed file (default: 1). Timed out files are not retried.')
+
+    parser.add_argument('-f', '--force',
+                        dest='force',
+                        action='store_true',
+                        help='Decompile also files whose outputs already exist.')
+
+    parser.add_argument('-s', '--summary',
+                        dest='summary',
+                        metavar='FILE',
+                        help='Summary file (default: summary.json in the output directory).')
+
+    parser.add_argument('-k', '--keep-work-dirs',
+                        dest='keep_work_dirs',
+                        action='store_true',
+                        help='Keep the working directories (IDBs and IDA logs) of the jobs.')
+
+    parser.add_argument('--ea64',
+                        dest='ea64',
+                        action='store_true',
+                        help='Use 64-bit address space plugin, i.e. retdec64 library and idat64 executable.')
+
+    return parser.parse_args(args)
+
+
+def check_args(args):
+    if args.ida_dir is None:
+        print_error_and_die('Path to IDA directory was not specified.')
+    if not os.path.isdir(args.ida_dir):
+        print_error_and_die('Specified path to IDA directory is not a directory:', args.ida_dir)
+
+    if args.ea64:
+        args.idat_path = os.path.join(args.ida_dir, 'idat64.exe' if is_windows() else 'idat64')
+    else:
+        args.idat_path = os.path.join(args.ida_dir, 'idat.exe' if is_windows() else 'idat')
+
+    if not os.path.exists(args.idat_path):
+        print_error_and_die('IDA console application does not exist:', args.idat_path)
+
+    # Without the worker, the plugin decompiles inside IDA, without limits.
+    worker_path = os.path.join(args.ida_dir, 'plugins', 'retdec',
+                               'retdec-idaplugin-worker.exe' if is_windows() else 'retdec-idaplugin-worker')
+    if not os.path.exists(worker_path):
+        print_error_and_die('Decompilation worker does not exist:', worker_path)
+    # IDA runs in the working directories of the jobs.
+    args.idat_path = os.path.abspath(args.idat_path)
+
+    if not os.path.isfile(args.manifest):
+        print_error_and_die('Specified manifest does not exist:', args.manifest)
+
+    if args.jobs < 1:
+        print_error_and_die('Number of jobs must be at least 1:', args.jobs)
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    args.output_dir = os.path.abspath(args.output_dir)
+    args.work_dir = os.path.join(args.output_dir, '.work')
+
+    if not args.summary:
+        args.summary = os.path.join(args.output_dir, 'summary.json')
+
+
+def read_manifest(path, output_dir):
+    """Returns a list of jobs - dictionaries with 'file', 'output', 'idb',
+    and 'select' keys.
+    """
+    base_dir = os.path.dirname(os.path.abspath(path))
+    jobs = []
+    outputs = set()
+    with open(path, 'r') as f:
+        for n, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+
+            if line.startswith('{'):
+                try:
+                    job = json.loads(line)
+                except ValueError as e:
+                    print_error_and_die('%s:%d: invalid JSON: %s' % (path, n, e))
+            else:
+                job = {'file': line}
+            if 'file' not in job:
+                print_error_and_die('%s:%d: missing input file' % (path, n))
+
+            job['file'] = os.path.join(base_dir, job['file'])
+            if job.get('idb'):
+                job['idb'] = os.path.join(base_dir, job['idb'])
+            if job.get('output'):
+                job['output'] = os.path.join(base_dir, job['output'])
+            else:
+                job['output'] = os.path.join(output_dir, os.path.basename(job['file']) + '.c')
+            job['select'] = [str(a) for a in job.get('select', [])]
+
+            # Jobs must not overwrite outputs of each other.
+            if job['output'] in outputs:
+                print_error_and_die('%s:%d: duplicate output file: %s' % (path, n, job['output']))
+            outputs.add(job['output'])
+
+            jobs.append(job)
+    return jobs
+
+
+def kill(proc):
+    if is_windows():
+        proc.kill()
+    else:
+        # IDA may have started its own children.
+        os.killpg(proc.pid, signal.SIGKILL)
+    proc.wait()
+
+
+def run_ida(args, job, work_dir):
+    """Runs IDA on one file. Returns (status, rc), where status is one of
+    'ok', 'failed', and 'timeout'.
+    """
+    if os.path.isdir(work_dir):
+        shutil.rmtree(work_dir)
+    os.makedirs(work_dir)
+
+    # Plugin produces "<input>.c" and IDA creates its database next to the
+    # input, so each job works with its own copy.
+    ida_file = os.path.join(work_dir, os.path.basename(job['file']))
+    shutil.copy(job['file'], ida_file)
+    ida_in = ida_file
+    if job.get('idb'):
+        ida_in = os.path.join(work_dir, os.path.basename(job['idb']))
+        shutil.copy(job['idb'], ida_in)
+
+    # One worker process - the decompilation is not split, and runs within
+    # the worker's limits.
+    plugin_options = ['workers=1']
+    if args.timeout:
+        plugin_options.append('timeout=%d' % args.timeout)
+    if args.max_memory:
+        plugin_options.append('worker_max_memory=%d' % args.max_memory)
+
+    cmd = [args.idat_path, '-A', '-Oretdec:' + ','.join(plugin_options)]
+    cmd.append('-L' + os.path.join(work_dir, 'ida.log'))
+    if job['select']:
+        cmd.append('-S' + script_batch + ' "' + ida_file + '" ' + ' '.join(job['select']))
+    else:
+        cmd.append('-S' + script_full + ' "' + ida_file + '"')
+    cmd.append(ida_in)
+
+    kwargs = {}
+    if not is_windows():
+        kwargs['start_new_session'] = True
+    with open(os.path.join(work_dir, 'stdout.log'), 'wb') as log:
+        proc = subprocess.Popen(cmd, cwd=work_dir, stdin=subprocess.DEVNULL,
+                                stdout=log, stderr=subprocess.STDOUT, **kwargs)
+        try:
+            # The worker process gets the same limit, give IDA some time to
+            # load the input and to exit.
+            rc = proc.wait(timeout=args.timeout * 2 + 60 if args.timeout else None)
+        except subprocess.TimeoutExpired:
+            kill(proc)
+            return 'timeout', None
+
+    out = ida_file + '.c'
+    if rc != 0 or not os.path.isfile(out) or os.path.getsize(out) == 0:
+        return 'failed', rc
+
+    output_dir = os.path.dirname(job['output'])
+    if output_dir:
+        os.makedirs(output_dir, exist_ok=True)
+    shutil.move(out, job['output'])
+    return 'ok', rc
+
+
+class Summary:
+    """Per-file results, written into the summary file after every file, so
+    that an interrupted run leaves a usable summary behind.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.files = []
+        self.start = time.time()
+
+    def add(self, result):
+        with self.lock:
+            self.files.append(result)
+            print('%-8s %7.1fs  %s' % (result['status'].upper(), result['seconds'], result['file']))
+            self.write()
+
+    def counts(self):
+        ret = {}
+        for r in self.files:
+            ret[r['status']] = ret.get(r['status'], 0) + 1
+        return ret
+
+    def write(self):
+        summary = {
+            'seconds': round(time.time() - self.start, 3),
+            'counts': self.counts(),
+            'files': self.files,
+        }
+        tmp = self.path + '.tmp'
+        with open(tmp, 'w') as f:
+            json.dump(summary, f, indent=2)
+        os.replace(tmp, self.path)
+
+
+def decompile_file(args, job, index, summary):
+    result = {
+        'file': job['file'],
+        'output': job['output'],
+        'status': 'skipped',
+        'rc': None,
+        'attempts': 0,
+        'seconds': 0.0,
+    }
+
+    if not args.force and os.path.isfile(job['output']) and os.path.getsize(job['output']) > 0:
+        summary.add(result)
+        return result
+
+    if not os.path.isfile(job['file']):
+        result['status'] = 'missing'
+        summary.add(result)
+        return result
+
+    work_dir = os.path.join(args.work_dir, '%d-%s' % (index, os.path.basename(job['file'])))
+    start = time.time()
+    while result['attempts'] <= args.retries:
+        result['attempts'] += 1
+        try:
+            result['status'], result['rc'] = run_ida(args, job, work_dir)
+        except OSError as e:
+            result['status'], result['rc'] = 'failed', None
+            result['error'] = str(e)
+        # Timeout would most likely repeat.
+        if result['status'] in ('ok', 'timeout'):
+            break
+    result['seconds'] = round(time.time() - start, 3)
+
+    if result['status'] != 'ok':
+        result['work_dir'] = work_dir
+    elif not args.keep_work_dirs:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    summary.add(result)
+    return result
+
+
+def main():
+    args = parse_args(sys.argv[1:])
+    check_args(args)
+
+    jobs = read_manifest(args.manifest, args.output_dir)
+    summary = Summary(args.summary)
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = [pool.submit(decompile_file, args, job, i, summary)
+                   for i, job in enumerate(jobs)]
+        for f in concurrent.futures.as_completed(futures):
+            f.result()
+
+    summary.write()
+    counts = summary.counts()
+    print('Done: ' + ', '.join('%d %s' % (n, s) for s, n in sorted(counts.items())))
+    print('Summary: ' + args.summary)
+    return 0 if all(s in ('ok', 'skipped') for s in counts) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,298 @@
+
+#include <iostream>
+
+#include <lines.hpp>
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+
+#include <retdec/common/address.h>
+
+#include "bench/baseline.h"
+
+namespace baseline {
+
+std::map<Token::Kind, std::string> TokenColors =
+{
+	{Token::Kind::NEW_LINE, SCOLOR_DEFAULT},
+	{Token::Kind::WHITE_SPACE, SCOLOR_DEFAULT},
+	{Token::Kind::PUNCTUATION, SCOLOR_KEYWORD},
+	{Token::Kind::OPERATOR, SCOLOR_KEYWORD},
+	{Token::Kind::ID_GVAR, SCOLOR_DREF},
+	{Token::Kind::ID_LVAR, SCOLOR_DREF},
+	{Token::Kind::ID_MEM, SCOLOR_DREF},
+	{Token::Kind::ID_LAB, SCOLOR_DREF},
+	{Token::Kind::ID_FNC, SCOLOR_DEFAULT},
+	{Token::Kind::ID_ARG, SCOLOR_DREF},
+	{Token::Kind::KEYWORD, SCOLOR_MACRO},
+	{Token::Kind::TYPE, SCOLOR_MACRO},
+	{Token::Kind::PREPROCESSOR, SCOLOR_AUTOCMT},
+	{Token::Kind::INCLUDE, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_BOOL, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_INT, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_FP, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_STR, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_SYM, SCOLOR_NUMBER},
+	{Token::Kind::LITERAL_PTR, SCOLOR_NUMBER},
+	{Token::Kind::COMMENT, SCOLOR_AUTOCMT},
+};
+
+std::map<Token::Kind, std::string> TokenKindStrings =
+{
+	{Token::Kind::NEW_LINE, "NEW_LINE"},
+	{Token::Kind::WHITE_SPACE, "WHITE_SPACE"},
+	{Token::Kind::PUNCTUATION, "PUNCTUATION"},
+	{Token::Kind::OPERATOR, "OPERATOR"},
+	{Token::Kind::ID_GVAR, "ID_GVAR"},
+	{Token::Kind::ID_LVAR, "ID_LVAR"},
+	{Token::Kind::ID_MEM, "ID_MEM"},
+	{Token::Kind::ID_LAB, "ID_LAB"},
+	{Token::Kind::ID_FNC, "ID_FNC"},
+	{Token::Kind::ID_ARG, "ID_ARG"},
+	{Token::Kind::KEYWORD, "KEYWORD"},
+	{Token::Kind::TYPE, "TYPE"},
+	{Token::Kind::PREPROCESSOR, "PREPROCESSOR"},
+	{Token::Kind::INCLUDE, "INCLUDE"},
+	{Token::Kind::LITERAL_BOOL, "LITERAL_BOOL"},
+	{Token::Kind::LITERAL_INT, "LITERAL_INT"},
+	{Token::Kind::LITERAL_FP, "LITERAL_FP"},
+	{Token::Kind::LITERAL_STR, "LITERAL_STR"},
+	{Token::Kind::LITERAL_SYM, "LITERAL_SYM"},
+	{Token::Kind::LITERAL_PTR, "LITERAL_PTR"},
+	{Token::Kind::COMMENT, "COMMENT"},
+};
+
+bool parseKind(const std::string& k, Token::Kind& kind)
+{
+	if (k == "nl") kind = Token::Kind::NEW_LINE;
+	else if (k == "ws") kind = Token::Kind::WHITE_SPACE;
+	else if (k == "punc") kind = Token::Kind::PUNCTUATION;
+	else if (k == "op") kind = Token::Kind::OPERATOR;
+	else if (k == "i_gvar") kind = Token::Kind::ID_GVAR;
+	else if (k == "i_lvar") kind = Token::Kind::ID_LVAR;
+	else if (k == "i_mem") kind = Token::Kind::ID_MEM;
+	else if (k == "i_lab") kind = Token::Kind::ID_LAB;
+	else if (k == "i_fnc") kind = Token::Kind::ID_FNC;
+	else if (k == "i_arg") kind = Token::Kind::ID_ARG;
+	else if (k == "keyw") kind = Token::Kind::KEYWORD;
+	else if (k == "type") kind = Token::Kind::TYPE;
+	else if (k == "preproc") kind = Token::Kind::PREPROCESSOR;
+	else if (k == "inc") kind = Token::Kind::INCLUDE;
+	else if (k == "l_bool") kind = Token::Kind::LITERAL_BOOL;
+	else if (k == "l_int") kind = Token::Kind::LITERAL_INT;
+	else if (k == "l_fp") kind = Token::Kind::LITERAL_FP;
+	else if (k == "l_str") kind = Token::Kind::LITERAL_STR;
+	else if (k == "l_sym") kind = Token::Kind::LITERAL_SYM;
+	else if (k == "l_ptr") kind = Token::Kind::LITERAL_PTR;
+	else if (k == "cmnt") kind = Token::Kind::COMMENT;
+	else return true;
+	return false;
+}
+
+const std::string& getColorTag(Token::Kind k)
+{
+	return TokenColors[k];
+}
+
+const std::string& getKindString(Token::Kind k)
+{
+	return TokenKindStrings[k];
+}
+
+std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa)
+{
+	std::vector<Token> res;
+
+	rapidjson::StringStream rss(json.c_str());
+	rapidjson::Document d;
+	rapidjson::ParseResult ok = d.ParseStream(rss);
+	if (!ok)
+	{
+		std::cerr << "Unable to parse decompilation output: "
+				<< GetParseError_En(ok.Code()) << std::endl;
+		return res;
+	}
+
+	auto tokens = d.FindMember("tokens");
+	if (tokens == d.MemberEnd() || !tokens->value.IsArray())
+	{
+		std::cerr << "Unable to parse tokens from decompilation output."
+				<< std::endl;
+		return res;
+	}
+
+	ea_t ea = defaultEa;
+
+	for (auto i = tokens->value.Begin(), e = tokens->value.End(); i != e; ++i)
+	{
+		auto& obj = *i;
+		if (obj.IsNull())
+		{
+			continue;
+		}
+
+		auto addr = obj.FindMember("addr");
+		if (addr != obj.MemberEnd() && addr->value.IsString())
+		{
+			retdec::common::Address a(addr->value.GetString());
+			ea = a.isDefined() ? a.getValue() : defaultEa;
+		}
+		auto kind = obj.FindMember("kind");
+		auto val = obj.FindMember("val");
+		if (kind != obj.MemberEnd() && kind->value.IsString()
+				&& val != obj.MemberEnd() && val->value.IsString())
+		{
+			Token::Kind kk;
+			if (parseKind(kind->value.GetString(), kk))
+			{
+				continue;
+			}
+			res.emplace_back(Token(kk, ea, val->value.GetString()));
+		}
+	}
+
+	return res;
+}
+
+//
+//==============================================================================
+// Function
+//==============================================================================
+//
+
+Function::Function(func_t* f, const std::vector<Token>& tokens)
+		: _fnc(f)
+{
+	std::size_t y = YX::starting_y;
+	std::size_t x = YX::starting_x;
+	for (auto& t : tokens)
+	{
+		_tokens[YX(y, x)] = t;
+
+		if (_ea2yx.count(t.ea) == 0)
+		{
+			_ea2yx[t.ea] = YX(y, x);
+		}
+
+		if (t.kind == Token::Kind::NEW_LINE)
+		{
+			++y;
+			x = YX::starting_x;
+		}
+		else
+		{
+			x += t.value.size();
+		}
+	}
+}
+
+const Token* Function::getToken(YX yx) const
+{
+	auto it = _tokens.find(adjust_yx(yx));
+	return it == _tokens.end() ? nullptr : &it->second;
+}
+
+YX Function::min_yx() const
+{
+	return _tokens.empty() ? YX::starting_yx : _tokens.begin()->first;
+}
+
+YX Function::max_yx() const
+{
+	return _tokens.empty() ? YX::starting_yx : _tokens.rbegin()->first;
+}
+
+YX Function::prev_yx(YX yx) const
+{
+	auto it = _tokens.find(adjust_yx(yx));
+	if (it == _tokens.end() || it == _tokens.begin())
+	{
+		return yx;
+	}
+	--it;
+	return it->first;
+}
+
+YX Function::next_yx(YX yx) const
+{
+	auto it = _tokens.find(adjust_yx(yx));
+	auto nit = it;
+	++nit;
+	if (it == _tokens.end() || nit == _tokens.end())
+	{
+		return yx;
+	}
+	return nit->first;
+}
+
+YX Function::adjust_yx(YX yx) const
+{
+	if (_tokens.empty() || _tokens.count(yx))
+	{
+		return yx;
+	}
+	if (yx <= min_yx())
+	{
+		return min_yx();
+	}
+	if (yx >= max_yx())
+	{
+		return max_yx();
+	}
+
+	auto it = _tokens.upper_bound(yx);
+	--it;
+	return it->first;
+}
+
+std::string Function::line_yx(YX yx) const
+{
+	std::string line;
+
+	auto it = _tokens.find(adjust_yx(yx));
+	while (it != _tokens.end()
+			&& it->first.y == yx.y
+			&& it->second.kind != Token::Kind::NEW_LINE)
+	{
+		line += std::string(SCOLOR_ON)
+				+ getColorTag(it->second.kind)
+				+ it->second.value
+				+ SCOLOR_OFF
+				+ getColorTag(it->second.kind);
+		++it;
+	}
+
+	return line;
+}
+
+ea_t Function::yx_2_ea(YX yx) const
+{
+	auto it = _tokens.find(adjust_yx(yx));
+	if (it == _tokens.end())
+	{
+		return BADADDR;
+	}
+	return it->second.ea;
+}
+
+YX Function::ea_2_yx(ea_t ea) const
+{
+	if (_ea2yx.empty())
+	{
+		return YX::starting_yx;
+	}
+	if (ea < _ea2yx.begin()->first || _ea2yx.rbegin()->first < ea)
+	{
+		return YX::starting_yx;
+	}
+	if (ea == _ea2yx.rbegin()->first)
+	{
+		return max_yx();
+	}
+
+	auto it = _ea2yx.upper_bound(ea);
+	--it;
+	return it->second;
+}
+
+} // namespace baseline
@@ -0,0 +1,64 @@
+
+#ifndef RETDEC_BENCH_BASELINE_H
+#define RETDEC_BENCH_BASELINE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "idaplugin/token.h"
+#include "idaplugin/yx.h"
+
+/**
+ * Original implementations of the decompilation output processing, which
+ * the current ones are compared with. They are kept only for the benchmarks.
+ */
+namespace baseline {
+
+/**
+ * Token kind from its name in RetDec's JSON output, by a chain of string
+ * comparisons.
+ * Returns \c true if \p k is not a known token kind.
+ */
+bool parseKind(const std::string& k, Token::Kind& kind);
+
+/**
+ * Token::getColorTag() and Token::getKindString() looked up in std::map.
+ */
+const std::string& getColorTag(Token::Kind k);
+const std::string& getKindString(Token::Kind k);
+
+/**
+ * parseTokens() building the whole rapidjson::Document and parsing
+ * addresses by retdec::common::Address.
+ */
+std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa);
+
+/**
+ * Function keeping its tokens in std::map<YX, Token> and its addresses in
+ * std::map<ea_t, YX>, only with the lookups of the benchmarks.
+ */
+class Function
+{
+	public:
+		Function(func_t* f, const std::vector<Token>& tokens);
+
+		const Token* getToken(YX yx) const;
+		YX min_yx() const;
+		YX max_yx() const;
+		YX prev_yx(YX yx) const;
+		YX next_yx(YX yx) const;
+		YX adjust_yx(YX yx) const;
+		std::string line_yx(YX yx) const;
+		ea_t yx_2_ea(YX yx) const;
+		YX ea_2_yx(ea_t ea) const;
+
+	private:
+		func_t* _fnc = nullptr;
+		std::map<YX, Token> _tokens;
+		std::map<ea_t, YX> _ea2yx;
+};
+
+} // namespace baseline
+
+#endif
@@ -0,0 +1,583 @@
+/**
+ * Benchmarks of the decompilation output processing.
+ *
+ * Compares the current implementation with the original one (see
+ * baseline.h) on RetDec's JSON output - a saved one, or a synthetic one with
+ * the given number of tokens. Every benchmark prints the best wall time of
+ * the runs and the peak heap taken by a run.
+ *
+ * Usage: retdec-idaplugin-bench [-n <tokens>] [-r <runs>] [-f <output.json>]
+ *                               [<benchmark> ...]
+ * Without benchmarks, all of them are run.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench/baseline.h"
+#include "idaplugin/function.h"
+#include "idaplugin/token.h"
+
+//
+//==============================================================================
+// Heap usage
+//==============================================================================
+//
+
+namespace {
+
+/// Bytes allocated by operator new and not yet freed, and their maximum.
+/// The benchmarks run on a single thread.
+std::size_t heapLive = 0;
+std::size_t heapPeak = 0;
+
+/// Size of the allocated block is stored in front of it.
+constexpr std::size_t heapHeader = alignof(std::max_align_t);
+
+} // anonymous namespace
+
+void* operator new(std::size_t size)
+{
+	auto* block = static_cast<char*>(std::malloc(size + heapHeader));
+	if (block == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	*reinterpret_cast<std::size_t*>(block) = size;
+	heapLive += size;
+	heapPeak = std::max(heapPeak, heapLive);
+	return block + heapHeader;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr == nullptr)
+	{
+		return;
+	}
+	auto* block = static_cast<char*>(ptr) - heapHeader;
+	heapLive -= *reinterpret_cast<std::size_t*>(block);
+	std::free(block);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+namespace {
+
+//
+//==============================================================================
+// Measurement
+//==============================================================================
+//
+
+struct Result
+{
+	/// Best wall time of the runs [ms].
+	double ms = std::numeric_limits<double>::max();
+	/// Peak heap of a run, above the heap taken before it [B].
+	std::size_t peak = 0;
+};
+
+/**
+ * Run \p fnc \p runs times. Whatever it allocates and frees is included.
+ */
+template <typename F>
+Result measure(unsigned runs, F fnc)
+{
+	Result res;
+	for (unsigned i = 0; i < runs; ++i)
+	{
+		std::size_t before = heapLive;
+		heapPeak = heapLive;
+		auto start = std::chrono::steady_clock::now();
+		fnc();
+		auto end = std::chrono::steady_clock::now();
+		res.ms = std::min(
+				res.ms,
+				std::chrono::duration<double, std::milli>(end - start).count()
+		);
+		res.peak = std::max(res.peak, heapPeak - before);
+	}
+	return res;
+}
+
+double mb(std::size_t bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+void header(const std::string& name)
+{
+	std::cout << std::left << std::setw(32) << name << std::right
+			<< std::setw(12) << "baseline"
+			<< std::setw(12) << "current"
+			<< std::setw(12) << "ratio" << std::endl;
+}
+
+/// Values of the baseline and the current implementation, and their ratio.
+void row(const std::string& name, double base, double cur)
+{
+	std::cout << "  " << std::left << std::setw(30) << name << std::right
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << base
+			<< std::setw(12) << cur
+			<< std::setprecision(2)
+			<< std::setw(11) << (cur > 0.0 ? base / cur : 0.0) << "x"
+			<< std::endl;
+}
+
+//
+//==============================================================================
+// Input
+//==============================================================================
+//
+
+struct Input
+{
+	std::string json;
+	std::vector<Token> tokens;
+	unsigned runs = 5;
+};
+
+/**
+ * Kind names used in RetDec's JSON output, indexed by Token::Kind.
+ */
+const char* jsonKinds[] =
+{
+	"nl", "ws", "punc", "op", "i_gvar", "i_lvar", "i_mem", "i_lab", "i_fnc",
+	"i_arg", "keyw", "type", "preproc", "inc", "l_bool", "l_int", "l_fp",
+	"l_str", "l_sym", "l_ptr", "cmnt",
+};
+
+std::string hex(ea_t ea)
+{
+	std::stringstream ss;
+	ss << "0x" << std::hex << ea;
+	return ss.str();
+}
+
+/**
+ * Synthetic decompilation output with at least \p count tokens - functions
+ * made of typical statements, each line with its own address.
+ */
+std::vector<Token> syntheticTokens(std::size_t count)
+{
+	using K = Token::Kind;
+	std::vector<Token> ts;
+	ts.reserve(count + 64);
+
+	ea_t ea = 0x401000;
+	auto add = [&ts, &ea] (K k, const std::string& v)
+	{
+		ts.emplace_back(k, ea, v);
+	};
+	auto ws = [&add] (const char* v = " ") { add(K::WHITE_SPACE, v); };
+	auto nl = [&add, &ea] { add(K::NEW_LINE, "\n"); ea += 4; };
+
+	for (unsigned f = 0; ts.size() < count; ++f)
+	{
+		ea_t start = ea;
+		std::string name = "function_" + hex(start).substr(2);
+		add(K::COMMENT, "// Address range: " + hex(start) + " - "
+				+ hex(start + 0x100));
+		nl();
+		add(K::TYPE, "int32_t"); ws(); add(K::ID_FNC, name);
+		add(K::PUNCTUATION, "("); add(K::TYPE, "int32_t"); ws();
+		add(K::ID_ARG, "a1"); add(K::PUNCTUATION, ","); ws();
+		add(K::TYPE, "char"); ws(); add(K::OPERATOR, "*");
+		add(K::ID_ARG, "a2"); add(K::PUNCTUATION, ")"); ws();
+		add(K::PUNCTUATION, "{"); nl();
+
+		for (unsigned s = 0; s < 8; ++s)
+		{
+			std::string v = "v" + std::to_string(s + 1);
+			ws("    "); add(K::TYPE, "int32_t"); ws(); add(K::ID_LVAR, v);
+			ws(); add(K::OPERATOR, "="); ws(); add(K::ID_ARG, "a1"); ws();
+			add(K::OPERATOR, "+"); ws(); add(K::LITERAL_INT, std::to_string(s));
+			add(K::PUNCTUATION, ";"); ws(); add(K::COMMENT, "// " + hex(ea));
+			nl();
+
+			ws("    "); add(K::KEYWORD, "if"); ws(); add(K::PUNCTUATION, "(");
+			add(K::ID_LVAR, v); ws(); add(K::OPERATOR, ">"); ws();
+			add(K::LITERAL_INT, "100"); add(K::PUNCTUATION, ")"); ws();
+			add(K::PUNCTUATION, "{"); nl();
+
+			ws("        "); add(K::ID_GVAR, "g" + std::to_string(f % 64));
+			ws(); add(K::OPERATOR, "="); ws(); add(K::ID_FNC, name);
+			add(K::PUNCTUATION, "("); add(K::ID_LVAR, v);
+			add(K::PUNCTUATION, ","); ws();
+			add(K::LITERAL_STR, "\"Unable to open the \\\"input\\\" file\\n\"");
+			add(K::PUNCTUATION, ")"); add(K::PUNCTUATION, ";"); nl();
+
+			ws("        "); add(K::OPERATOR, "*"); add(K::PUNCTUATION, "(");
+			add(K::TYPE, "int32_t"); ws(); add(K::OPERATOR, "*");
+			add(K::PUNCTUATION, ")"); add(K::ID_ARG, "a2"); ws();
+			add(K::OPERATOR, "="); ws(); add(K::LITERAL_PTR, hex(ea + 0x1000));
+			add(K::PUNCTUATION, ";"); nl();
+
+			ws("    "); add(K::PUNCTUATION, "}"); nl();
+		}
+
+		ws("    "); add(K::KEYWORD, "return"); ws(); add(K::ID_LVAR, "v1");
+		add(K::PUNCTUATION, ";"); nl();
+		add(K::PUNCTUATION, "}"); nl();
+		nl();
+	}
+
+	return ts;
+}
+
+void appendJsonString(std::string& json, const std::string& str)
+{
+	json += '"';
+	for (char c : str)
+	{
+		switch (c)
+		{
+			case '"': json += "\\\""; break;
+			case '\\': json += "\\\\"; break;
+			case '\n': json += "\\n"; break;
+			case '\t': json += "\\t"; break;
+			default: json += c; break;
+		}
+	}
+	json += '"';
+}
+
+/**
+ * Tokens in the format of RetDec's JSON output - an address object before
+ * every token whose address differs from the previous one.
+ */
+std::string toJson(const std::vector<Token>& tokens)
+{
+	std::string json = "{\"language\":\"C\",\"tokens\":[";
+	ea_t ea = BADADDR;
+	bool first = true;
+	for (auto& t : tokens)
+	{
+		if (t.ea != ea)
+		{
+			ea = t.ea;
+			json += first ? "" : ",";
+			json += "{\"addr\":\"" + hex(ea) + "\"}";
+			first = false;
+		}
+		json += first ? "" : ",";
+		json += "{\"kind\":\"";
+		json += jsonKinds[static_cast<std::size_t>(t.kind)];
+		json += "\",\"val\":";
+		appendJsonString(json, t.value);
+		json += "}";
+		first = false;
+	}
+	json += "]}";
+	return json;
+}
+
+//
+//==============================================================================
+// Benchmarks
+//==============================================================================
+//
+
+/**
+ * Function: tokens in std::map vs. flat arrays with a text arena.
+ */
+void benchFunction(const Input& in)
+{
+	if (in.tokens.empty())
+	{
+		return;
+	}
+
+	func_t fnc;
+	fnc.start_ea = in.tokens.front().ea;
+	fnc.end_ea = in.tokens.back().ea + 1;
+
+	auto baseBuild = measure(in.runs, [&] {
+		baseline::Function F(&fnc, in.tokens);
+	});
+	auto curBuild = measure(in.runs, [&] {
+		::Function F(&fnc, in.tokens);
+	});
+
+	std::size_t before = heapLive;
+	baseline::Function base(&fnc, in.tokens);
+	std::size_t baseBytes = heapLive - before;
+	before = heapLive;
+	::Function cur(&fnc, in.tokens);
+	std::size_t curBytes = heapLive - before;
+
+	// Random positions, the same for both functions.
+	const std::size_t lookups = 1000000;
+	std::size_t lines = cur.max_yx().y;
+	std::mt19937_64 rng(1);
+	std::vector<YX> yxs;
+	std::vector<ea_t> eas;
+	for (std::size_t i = 0; i < lookups; ++i)
+	{
+		yxs.emplace_back(YX::starting_y + rng() % lines, rng() % 80);
+		eas.push_back(fnc.start_ea + rng() % (fnc.end_ea - fnc.start_ea));
+	}
+
+	std::size_t baseSum = 0;
+	std::size_t curSum = 0;
+	auto walk = [&] (const auto& F, std::size_t& sum) {
+		sum = 0;
+		YX yx = F.min_yx();
+		for (YX n = F.next_yx(yx); !(n == yx); n = F.next_yx(yx))
+		{
+			sum += n.x;
+			yx = n;
+		}
+	};
+	auto baseWalk = measure(in.runs, [&] { walk(base, baseSum); });
+	auto curWalk = measure(in.runs, [&] { walk(cur, curSum); });
+	bool differ = baseSum != curSum;
+
+	auto adjust = [&] (const auto& F, std::size_t& sum) {
+		sum = 0;
+		for (auto& yx : yxs)
+		{
+			sum += F.adjust_yx(yx).x + F.yx_2_ea(yx);
+		}
+	};
+	auto baseAdjust = measure(in.runs, [&] { adjust(base, baseSum); });
+	auto curAdjust = measure(in.runs, [&] { adjust(cur, curSum); });
+	differ |= baseSum != curSum;
+
+	auto ea2yx = [&] (const auto& F, std::size_t& sum) {
+		sum = 0;
+		for (auto ea : eas)
+		{
+			auto yx = F.ea_2_yx(ea);
+			sum += yx.y + yx.x;
+		}
+	};
+	auto baseEa = measure(in.runs, [&] { ea2yx(base, baseSum); });
+	auto curEa = measure(in.runs, [&] { ea2yx(cur, curSum); });
+	differ |= baseSum != curSum;
+
+	auto render = [&] (const auto& F, std::size_t& sum) {
+		sum = 0;
+		for (std::size_t y = YX::starting_y; y <= lines; ++y)
+		{
+			sum += F.line_yx(YX(y, YX::starting_x)).size();
+		}
+	};
+	auto baseRender = measure(in.runs, [&] { render(base, baseSum); });
+	auto curRender = measure(in.runs, [&] { render(cur, curSum); });
+	differ |= baseSum != curSum;
+
+	header("function");
+	row("build [ms]", baseBuild.ms, curBuild.ms);
+	row("build peak heap [MB]", mb(baseBuild.peak), mb(curBuild.peak));
+	row("retained heap [MB]", mb(baseBytes), mb(curBytes));
+	row("retained heap per token [B]",
+			double(baseBytes) / in.tokens.size(),
+			double(curBytes) / in.tokens.size());
+	row("next_yx() walk [ms]", baseWalk.ms, curWalk.ms);
+	row("1M adjust_yx()+yx_2_ea() [ms]", baseAdjust.ms, curAdjust.ms);
+	row("1M ea_2_yx() [ms]", baseEa.ms, curEa.ms);
+	row("line_yx() of all lines [ms]", baseRender.ms, curRender.ms);
+	if (differ)
+	{
+		std::cout << "  results differ" << std::endl;
+	}
+}
+
+/**
+ * Token kinds: a chain of string comparisons vs. a switch on the length and
+ * a distinguishing character, and std::map vs. array lookups of the color
+ * tags and kind names.
+ */
+void benchKinds(const Input& in)
+{
+	std::vector<std::string> names;
+	names.reserve(in.tokens.size());
+	for (auto& t : in.tokens)
+	{
+		names.push_back(jsonKinds[static_cast<std::size_t>(t.kind)]);
+	}
+
+	std::size_t baseSum = 0;
+	std::size_t curSum = 0;
+	auto baseDecode = measure(in.runs, [&] {
+		baseSum = 0;
+		for (auto& n : names)
+		{
+			Token::Kind k = Token::Kind::NEW_LINE;
+			baseline::parseKind(n, k);
+			baseSum += static_cast<std::size_t>(k);
+		}
+	});
+	auto curDecode = measure(in.runs, [&] {
+		curSum = 0;
+		for (auto& n : names)
+		{
+			Token::Kind k = Token::Kind::NEW_LINE;
+			Token::kindFromJson(n, k);
+			curSum += static_cast<std::size_t>(k);
+		}
+	});
+
+	std::size_t baseTags = 0;
+	std::size_t curTags = 0;
+	auto baseEncode = measure(in.runs, [&] {
+		baseTags = 0;
+		for (auto& t : in.tokens)
+		{
+			baseTags += baseline::getColorTag(t.kind)[0]
+					+ baseline::getKindString(t.kind)[0];
+		}
+	});
+	auto curEncode = measure(in.runs, [&] {
+		curTags = 0;
+		for (auto& t : in.tokens)
+		{
+			curTags += t.getColorTag()[0] + t.getKindString()[0];
+		}
+	});
+
+	header("kinds");
+	row("decode [ms]", baseDecode.ms, curDecode.ms);
+	row("color tag and name [ms]", baseEncode.ms, curEncode.ms);
+	if (baseSum != curSum || baseTags != curTags)
+	{
+		std::cout << "  results differ" << std::endl;
+	}
+}
+
+/**
+ * parseTokens(): rapidjson::Document vs. SAX reader.
+ */
+void benchParse(const Input& in)
+{
+	std::size_t baseCount = 0;
+	std::size_t curCount = 0;
+	auto base = measure(in.runs, [&] {
+		baseCount = baseline::parseTokens(in.json, 0).size();
+	});
+	auto cur = measure(in.runs, [&] {
+		curCount = parseTokens(in.json, 0).size();
+	});
+
+	header("parse");
+	row("time [ms]", base.ms, cur.ms);
+	row("peak heap [MB]", mb(base.peak), mb(cur.peak));
+	if (baseCount != curCount)
+	{
+		std::cout << "  token counts differ: " << baseCount << " vs. "
+				<< curCount << std::endl;
+	}
+}
+
+const std::map<std::string, void (*)(const Input&)> benchmarks =
+{
+	{"function", benchFunction},
+	{"kinds", benchKinds},
+	{"parse", benchParse},
+};
+
+void usage(std::ostream& os)
+{
+	os << "Usage: retdec-idaplugin-bench [-n <tokens>] [-r <runs>]"
+			<< " [-f <output.json>] [<benchmark> ...]" << std::endl
+			<< "  -n  tokens of the synthetic output (default: 1000000)"
+			<< std::endl
+			<< "  -r  runs of each benchmark, the best one is shown"
+			<< " (default: 5)" << std::endl
+			<< "  -f  saved JSON output of the decompiler used instead of"
+			<< " the synthetic one" << std::endl
+			<< "Benchmarks:";
+	for (auto& b : benchmarks)
+	{
+		os << " " << b.first;
+	}
+	os << " (default: all)" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	Input in;
+	std::size_t count = 1000000;
+	std::string file;
+	std::set<std::string> selected;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if ((arg == "-n" || arg == "-r" || arg == "-f") && i + 1 < argc)
+		{
+			std::string val = argv[++i];
+			if (arg == "-n") count = std::stoull(val);
+			else if (arg == "-r") in.runs = std::max(1ul, std::stoul(val));
+			else file = val;
+		}
+		else if (arg == "-h" || arg == "--help")
+		{
+			usage(std::cout);
+			return 0;
+		}
+		else if (benchmarks.count(arg))
+		{
+			selected.insert(arg);
+		}
+		else
+		{
+			usage(std::cerr);
+			return 1;
+		}
+	}
+
+	if (file.empty())
+	{
+		in.tokens = syntheticTokens(count);
+		in.json = toJson(in.tokens);
+	}
+	else
+	{
+		std::ifstream ifs(file, std::ios::binary);
+		if (!ifs)
+		{
+			std::cerr << "Unable to open " << file << std::endl;
+			return 1;
+		}
+		std::stringstream ss;
+		ss << ifs.rdbuf();
+		in.json = ss.str();
+		in.tokens = parseTokens(in.json, 0);
+	}
+
+	std::cout << in.tokens.size() << " tokens, "
+			<< std::fixed << std::setprecision(1) << mb(in.json.size())
+			<< " MB of JSON, best of " << in.runs << " runs" << std::endl
+			<< std::endl;
+
+	for (auto& b : benchmarks)
+	{
+		if (selected.empty() || selected.count(b.first))
+		{
+			b.second(in);
+			std::cout << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,568 @@
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+
+#include <retdec/crypto/crypto.h>
+
+#include "cache.h"
+#include "decompilation.h"
+#include "profiler.h"
+
+netnode IdbCache::node()
+{
+	netnode n(_nodeName, 0, true);
+	// Drop overlapping version 1 blobs, they are never read.
+	if (n.supfirst(_tag) != BADNODE)
+	{
+		n.supdel_all(_tag);
+	}
+	return n;
+}
+
+netnode IdbCache::functionNode(ea_t fncStart, bool create)
+{
+	netnode n = create ? node() : netnode(_nodeName);
+	if (n == BADNODE)
+	{
+		return BADNODE;
+	}
+
+	nodeidx_t id = n.altval(fncStart, _nodeTag);
+	if (id != 0)
+	{
+		return netnode(id);
+	}
+	if (!create)
+	{
+		return BADNODE;
+	}
+
+	netnode fn;
+	fn.create();
+	n.altset(fncStart, fn, _nodeTag);
+	return fn;
+}
+
+bool IdbCache::load(ea_t fncStart, std::vector<Token>& tokens)
+{
+	Profiler::Phase phase("idb.load");
+	netnode n = functionNode(fncStart, false);
+	if (n == BADNODE)
+	{
+		return true;
+	}
+
+	bytevec_t blob;
+	if (n.getblob(&blob, 0, _tag) <= 0)
+	{
+		return true;
+	}
+
+	const uchar* ptr = blob.begin();
+	const uchar* end = blob.end();
+	if (unpack_dd(&ptr, end) != _version)
+	{
+		return true;
+	}
+
+	return deserializeTokens(&ptr, end, tokens);
+}
+
+void IdbCache::store(ea_t fncStart, const std::vector<Token>& tokens)
+{
+	Profiler::Phase phase("idb.store");
+	bytevec_t blob;
+	blob.pack_dd(_version);
+	serializeTokens(&blob, tokens);
+
+	functionNode(fncStart, true).setblob(blob.begin(), blob.size(), 0, _tag);
+}
+
+bool IdbCache::contains(ea_t fncStart)
+{
+	return functionNode(fncStart, false) != BADNODE;
+}
+
+std::vector<std::size_t> IdbCache::renameTokens(
+		ea_t fncStart,
+		const std::vector<std::size_t>* indexes,
+		Token::Kind k,
+		const std::string& oldVal,
+		const std::string& newVal)
+{
+	std::vector<std::size_t> renamed;
+	std::vector<Token> ts;
+	if (load(fncStart, ts))
+	{
+		return renamed;
+	}
+
+	auto rename = [&] (std::size_t i)
+	{
+		if (i < ts.size() && ts[i].kind == k && ts[i].value == oldVal)
+		{
+			ts[i].value = newVal;
+			renamed.push_back(i);
+		}
+	};
+	if (indexes)
+	{
+		for (auto i : *indexes)
+		{
+			rename(i);
+		}
+	}
+	else
+	{
+		for (std::size_t i = 0; i < ts.size(); ++i)
+		{
+			rename(i);
+		}
+	}
+
+	if (!renamed.empty())
+	{
+		store(fncStart, ts);
+	}
+	return renamed;
+}
+
+void IdbCache::remove(ea_t fncStart)
+{
+	netnode n(_nodeName);
+	if (n == BADNODE)
+	{
+		return;
+	}
+	if (nodeidx_t id = n.altval(fncStart, _nodeTag))
+	{
+		netnode(id).kill();
+		n.altdel(fncStart, _nodeTag);
+	}
+}
+
+//
+//==============================================================================
+// DiskCache
+//==============================================================================
+//
+
+DiskCache::DiskCache()
+{
+
+}
+
+DiskCache::~DiskCache()
+{
+	close();
+}
+
+void DiskCache::open(
+		const std::string& dir,
+		std::uint64_t maxSize,
+		std::uint64_t maxAge)
+{
+	close();
+	_dir = dir;
+	_maxSize = maxSize;
+	_maxAge = maxAge;
+	_stores = 0;
+	if (_dir.empty())
+	{
+		return;
+	}
+
+	std::error_code ec;
+	fs::create_directories(_dir, ec);
+	if (ec)
+	{
+		WARNING_MSG("Cannot create decompilation cache directory "
+				<< _dir.string() << ": " << ec.message() << "\n");
+		_dir.clear();
+		return;
+	}
+
+	// Trimming a large cache would delay loading of the plugin.
+	trim();
+}
+
+void DiskCache::close()
+{
+	if (_trimThread.joinable())
+	{
+		_trimThread.join();
+	}
+	_dir.clear();
+}
+
+bool DiskCache::enabled() const
+{
+	return !_dir.empty();
+}
+
+/**
+ * The config slice consists of the decompiler parameters, architecture,
+ * the function itself, and all the functions and globals it references.
+ * Paths that differ between IDBs of the same binary are removed from it.
+ * Bytes of the referenced data items (strings, constant tables, initialized
+ * globals) are hashed as well, they may change while the code does not.
+ */
+std::string DiskCache::key(
+		const retdec::config::Config& config,
+		func_t* f)
+{
+	Profiler::Phase phase("cache.key");
+	retdec::config::Config slice;
+	slice.parameters = config.parameters;
+	slice.parameters.setInputFile("");
+	slice.parameters.setOutputFile("");
+	selectRange(slice, f->start_ea, f->end_ea);
+	slice.architecture = config.architecture;
+	slice.fileFormat = config.fileFormat;
+	slice.structures = config.structures;
+
+	if (auto* ccFnc = config.functions.getFunctionByStartAddress(f->start_ea))
+	{
+		slice.functions.insert(*ccFnc);
+	}
+
+	std::set<ea_t> items;
+	func_item_iterator_t fii(f);
+	for (bool ok = true; ok; ok = fii.next_head())
+	{
+		xrefblk_t xb;
+		for (bool x = xb.first_from(fii.current(), XREF_FAR); x; x = xb.next_from())
+		{
+			if (auto* ccFnc = config.functions.getFunctionByStartAddress(xb.to))
+			{
+				slice.functions.insert(*ccFnc);
+			}
+			else if (auto* ccGv = config.globals.getObjectByAddress(xb.to))
+			{
+				slice.globals.insert(*ccGv);
+			}
+			if (!xb.iscode && !is_code(get_flags(xb.to)))
+			{
+				items.insert(get_item_head(xb.to));
+			}
+		}
+	}
+
+	std::string data = RELEASE_VERSION;
+	data += slice.generateJsonString();
+
+	for (ea_t ea : items)
+	{
+		std::string item(get_item_size(ea), '\0');
+		get_bytes(item.data(), item.size(), ea);
+		data += std::to_string(ea);
+		data += std::to_string(item.size());
+		data += item;
+	}
+
+	std::string bytes(f->size(), '\0');
+	get_bytes(bytes.data(), bytes.size(), f->start_ea);
+	data += std::to_string(f->start_ea);
+	data += bytes;
+
+	return retdec::crypto::getSha256(
+			reinterpret_cast<const unsigned char*>(data.data()),
+			data.size()
+	);
+}
+
+bool DiskCache::load(const std::string& key, std::vector<Token>& tokens)
+{
+	if (!enabled())
+	{
+		return true;
+	}
+	Profiler::Phase phase("cache.load");
+
+	auto path = entryPath(key);
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good())
+	{
+		return true;
+	}
+	std::string blob(
+			(std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>()
+	);
+	in.close();
+
+	auto* ptr = reinterpret_cast<const uchar*>(blob.data());
+	auto* end = ptr + blob.size();
+	if (unpack_dd(&ptr, end) != _version
+			|| deserializeTokens(&ptr, end, tokens))
+	{
+		return true;
+	}
+
+	// Entries are evicted in the least recently used order.
+	std::error_code ec;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+	return false;
+}
+
+void DiskCache::store(const std::string& key, const std::vector<Token>& tokens)
+{
+	if (!enabled())
+	{
+		return;
+	}
+	Profiler::Phase phase("cache.store");
+
+	bytevec_t blob;
+	blob.pack_dd(_version);
+	serializeTokens(&blob, tokens);
+
+	// The cache may be shared by several IDA instances.
+	// Write to a unique temporary file and atomically move it into place.
+	auto path = entryPath(key);
+	auto tmp = path;
+	tmp += "." + std::to_string(std::random_device()()) + ".tmp";
+
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	{
+		std::ofstream out(tmp, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(blob.begin()), blob.size());
+		if (!out.good())
+		{
+			out.close();
+			fs::remove(tmp, ec);
+			return;
+		}
+	}
+	fs::rename(tmp, path, ec);
+	if (ec)
+	{
+		fs::remove(tmp, ec);
+	}
+
+	if (++_stores >= _trimPeriod)
+	{
+		trim();
+	}
+}
+
+void DiskCache::trim()
+{
+	_stores = 0;
+	if (!enabled() || _trimming)
+	{
+		return;
+	}
+	if (_trimThread.joinable())
+	{
+		_trimThread.join();
+	}
+
+	fs::path dir = _dir;
+	auto maxSize = _maxSize;
+	auto maxAge = _maxAge;
+	_trimming = true;
+	_trimThread = std::thread([this, dir, maxSize, maxAge]
+	{
+		trim(dir, maxSize, maxAge);
+		_trimming = false;
+	});
+}
+
+void DiskCache::trim(
+		const fs::path& dir,
+		std::uint64_t maxSize,
+		std::uint64_t maxAge)
+{
+	struct Entry
+	{
+		fs::path path;
+		fs::file_time_type time;
+		std::uintmax_t size;
+	};
+	std::vector<Entry> entries;
+	std::uintmax_t total = 0;
+
+	auto now = fs::file_time_type::clock::now();
+	auto age = std::chrono::seconds(maxAge);
+
+	std::error_code ec;
+	for (auto it = fs::recursive_directory_iterator(dir, ec);
+			it != fs::recursive_directory_iterator();
+			it.increment(ec))
+	{
+		if (ec)
+		{
+			break;
+		}
+		if (!it->is_regular_file(ec))
+		{
+			continue;
+		}
+
+		Entry e{it->path(), it->last_write_time(ec), it->file_size(ec)};
+		if (ec)
+		{
+			continue;
+		}
+
+		if (now - e.time > age)
+		{
+			fs::remove(e.path, ec);
+			continue;
+		}
+
+		total += e.size;
+		entries.push_back(e);
+	}
+
+	if (total <= maxSize)
+	{
+		return;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](auto& a, auto& b)
+	{
+		return a.time < b.time;
+	});
+	for (auto& e : entries)
+	{
+		if (total <= maxSize)
+		{
+			break;
+		}
+		if (fs::remove(e.path, ec))
+		{
+			total -= e.size;
+		}
+	}
+}
+
+fs::path DiskCache::entryPath(const std::string& key) const
+{
+	// Spread entries into subdirectories to keep directories small.
+	return _dir / key.substr(0, 2) / key;
+}
+
+//
+//==============================================================================
+// FunctionCache
+//==============================================================================
+//
+
+void FunctionCache::setBudget(std::uint64_t budget)
+{
+	_budget = budget;
+	trim();
+}
+
+Function* FunctionCache::use(Function* F)
+{
+	touch(F);
+	if (_loaded.erase(F))
+	{
+		++_stats.misses;
+	}
+	else if (!F->isPlaceholder())
+	{
+		++_stats.hits;
+	}
+	return F;
+}
+
+Function* FunctionCache::touch(Function* F)
+{
+	auto it = _entries.find(F);
+	if (it != _entries.end())
+	{
+		_lru.splice(_lru.begin(), _lru, it->second);
+		return F;
+	}
+
+	bool reload = F->isReleased();
+	if (reload)
+	{
+		func_t* f = F->fnc();
+		std::vector<Token> ts;
+		if (IdbCache::load(f->start_ea, ts) || ts.empty())
+		{
+			*F = Function::placeholder(
+					f,
+					"// Decompiled code is no longer available."
+			);
+		}
+		else
+		{
+			*F = Function(f, ts);
+		}
+	}
+	update(F);
+	if (reload && !F->isPlaceholder())
+	{
+		loaded(F);
+	}
+	return F;
+}
+
+void FunctionCache::loaded(Function* F)
+{
+	_loaded.insert(F);
+}
+
+void FunctionCache::update(Function* F)
+{
+	_loaded.erase(F);
+	untrack(F);
+	if (!F->isPlaceholder() && !F->isReleased())
+	{
+		track(F);
+		trim();
+		_stats.peakBytes = std::max(_stats.peakBytes, _stats.bytes);
+	}
+}
+
+const FunctionCache::Stats& FunctionCache::stats() const
+{
+	return _stats;
+}
+
+void FunctionCache::track(Function* F)
+{
+	auto size = F->memoryUsage();
+	_lru.emplace_front(F, size);
+	_entries[F] = _lru.begin();
+
+	++_stats.functions;
+	_stats.bytes += size;
+}
+
+void FunctionCache::untrack(Function* F)
+{
+	auto it = _entries.find(F);
+	if (it == _entries.end())
+	{
+		return;
+	}
+
+	--_stats.functions;
+	_stats.bytes -= it->second->second;
+	_lru.erase(it->second);
+	_entries.erase(it);
+}
+
+void FunctionCache::trim()
+{
+	while (_budget && _stats.bytes > _budget && _lru.size() > 1)
+	{
+		Function* F = _lru.back().first;
+		untrack(F);
+		F->release();
+		++_stats.evictions;
+	}
+}
@@ -0,0 +1,206 @@
+#ifndef RETDEC_CACHE_H
+#define RETDEC_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <retdec/config/config.h>
+#include <retdec/utils/filesystem.h>
+
+#include "function.h"
+#include "token.h"
+#include "utils.h"
+
+/**
+ * Decompiled functions persisted in the IDB.
+ *
+ * Token stream of each decompiled function is stored as a blob in its own
+ * netnode. The plugin's netnode maps start addresses of the functions to
+ * their netnodes. Reopened IDB therefore shows already decompiled functions
+ * without decompiling them again.
+ *
+ * A blob takes one supval index per MAXSPECSIZE bytes, so blobs of different
+ * functions can not share one netnode indexed by addresses - a blob would
+ * overwrite blobs of the functions starting right after it.
+ */
+class IdbCache
+{
+	public:
+		/// Returns \c true if the function is not cached.
+		static bool load(ea_t fncStart, std::vector<Token>& tokens);
+		static void store(ea_t fncStart, const std::vector<Token>& tokens);
+		static void remove(ea_t fncStart);
+		/// Is the function cached? Does not load it.
+		static bool contains(ea_t fncStart);
+		/// Function::renameTokens() on the cached tokens, without creating
+		/// the function. All the tokens are searched if \p indexes is
+		/// \c nullptr. Returns indexes of the renamed tokens.
+		static std::vector<std::size_t> renameTokens(
+				ea_t fncStart,
+				const std::vector<std::size_t>* indexes,
+				Token::Kind k,
+				const std::string& oldVal,
+				const std::string& newVal
+		);
+
+	private:
+		static netnode node();
+		/// Netnode of the function's blob, \c BADNODE if there is none and
+		/// \p create is \c false.
+		static netnode functionNode(ea_t fncStart, bool create);
+
+	private:
+		inline static const char* _nodeName = "$ retdec decompiled";
+		/// Function starts -> their netnodes, altvals of the plugin's netnode.
+		inline static const uchar _nodeTag = 'N';
+		/// Blob in the function's netnode.
+		inline static const uchar _tag = 'T';
+		/// Increment whenever the blob format changes, old blobs are ignored.
+		/// Version 1 blobs were stored right in the plugin's netnode.
+		inline static const uint32 _version = 2;
+};
+
+/**
+ * Content-addressed decompilation cache shared across IDBs.
+ *
+ * Entries are files keyed by a hash of everything the selective decompilation
+ * of a function depends on - its address and bytes, the bytes of the data it
+ * references, and a slice of the config describing it, the objects it
+ * references, and the decompiler parameters. A hit skips the decompilation
+ * entirely. The cache is kept in bounds by removing old and least recently
+ * used entries in a background thread.
+ */
+class DiskCache
+{
+	public:
+		DiskCache();
+		~DiskCache();
+
+		DiskCache(const DiskCache&) = delete;
+		DiskCache& operator=(const DiskCache&) = delete;
+
+		/// Start using the cache, it is trimmed in the background.
+		/// \param dir     Cache directory. Empty string disables the cache.
+		/// \param maxSize Maximum size of all the entries [B].
+		/// \param maxAge  Maximum age of an entry [s].
+		void open(
+				const std::string& dir,
+				std::uint64_t maxSize,
+				std::uint64_t maxAge
+		);
+		/// Wait for the running trim() and disable the cache.
+		void close();
+
+		bool enabled() const;
+
+		/// Key of the function decompiled with the given config.
+		static std::string key(
+				const retdec::config::Config& config,
+				func_t* f
+		);
+		/// Returns \c true if the key is not cached.
+		bool load(const std::string& key, std::vector<Token>& tokens);
+		void store(const std::string& key, const std::vector<Token>& tokens);
+		/// Remove too old entries, then the least recently used ones until
+		/// the cache fits into its maximum size. Runs in a background thread,
+		/// does nothing if the previous trim is still running.
+		void trim();
+
+	private:
+		fs::path entryPath(const std::string& key) const;
+		static void trim(
+				const fs::path& dir,
+				std::uint64_t maxSize,
+				std::uint64_t maxAge
+		);
+
+	private:
+		fs::path _dir;
+		std::uint64_t _maxSize = 0;
+		std::uint64_t _maxAge = 0;
+		/// Number of stores since the last trim.
+		unsigned _stores = 0;
+		/// Thread of the last trim(), it touches only the files.
+		std::thread _trimThread;
+		std::atomic<bool> _trimming = false;
+
+		/// Trim the cache after this many stores.
+		inline static const unsigned _trimPeriod = 100;
+		/// Increment whenever the entry format changes, old entries are ignored.
+		inline static const uint32 _version = 1;
+};
+
+/**
+ * Memory budget of the decompiled functions.
+ *
+ * Functions are tracked from the most to the least recently used one. When
+ * they do not fit into the budget, the least recently used ones are released
+ * (see Function::release()). The Function objects themselves stay in place,
+ * so that pointers to them remain valid, and their tokens are loaded again
+ * from IdbCache when they are used next time.
+ */
+class FunctionCache
+{
+	public:
+		struct Stats
+		{
+			/// Displayed functions which were in memory.
+			std::uint64_t hits = 0;
+			/// Displayed functions which were loaded from IDB.
+			std::uint64_t misses = 0;
+			/// Released functions.
+			std::uint64_t evictions = 0;
+			/// Functions in memory and their memory usage [B].
+			std::size_t functions = 0;
+			std::uint64_t bytes = 0;
+			std::uint64_t peakBytes = 0;
+		};
+
+	public:
+		/// \param budget Maximum memory of all the functions [B],
+		///               0 = unlimited.
+		void setBudget(std::uint64_t budget);
+
+		/// Function is displayed - touch() it, and count it as a hit, or
+		/// as a miss if it had to be loaded from IDB. Returns \p F.
+		Function* use(Function* F);
+		/// Make the function the most recently used one and load it again
+		/// if it was released, without counting it (e.g. when IDA resolves
+		/// places). Returns \p F.
+		Function* touch(Function* F);
+		/// Function was loaded from IDB outside of the cache, its next use()
+		/// is a miss.
+		void loaded(Function* F);
+		/// Function's content changed (e.g. it was decompiled again, or
+		/// tokens were renamed), measure it again. Placeholders are not
+		/// tracked.
+		void update(Function* F);
+
+		const Stats& stats() const;
+
+	private:
+		using Entry = std::pair<Function*, std::size_t>;
+
+		void track(Function* F);
+		void untrack(Function* F);
+		/// Release the least recently used functions over the budget, the
+		/// most recently used one is always kept.
+		void trim();
+
+	private:
+		std::uint64_t _budget = 0;
+		/// The most recently used function first.
+		std::list<Entry> _lru;
+		std::unordered_map<Function*, std::list<Entry>::iterator> _entries;
+		/// Functions loaded from IDB and not used yet.
+		std::unordered_set<Function*> _loaded;
+		Stats _stats;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include <retdec/utils/binary_path.h>
 
 #include "config.h"
+#include "profiler.h"
 #include "retdec.h"
 #include "utils.h"
 
@@ -173,8 +174,56 @@ bool canDecompileInput(
 	return true;
 }
 
-bool generateHeader(retdec::config::Config& config, std::string out)
+/**
+ * Decompilation parameters from plugins/retdec/decompiler-config.json.
+ * The file is parsed only when it is modified, not for every decompilation.
+ * @param changed Set to \c true if the file was (re)loaded.
+ */
+const retdec::config::Config& getFileConfig(bool& changed)
 {
+	static retdec::config::Config fileConfig;
+	static bool loaded = false;
+	static bool exists = false;
+	static fs::file_time_type time;
+
+	auto idaPath = retdec::utils::getThisBinaryDirectoryPath();
+	auto configPath = idaPath;
+	configPath.append("plugins");
+	configPath.append("retdec");
+	configPath.append("decompiler-config.json");
+
+	std::error_code ec;
+	auto t = fs::last_write_time(configPath, ec);
+	bool e = !ec;
+	changed = !loaded || e != exists || (e && t != time);
+	if (!changed)
+	{
+		return fileConfig;
+	}
+	Profiler::Phase phase("config.file");
+
+	fileConfig = retdec::config::Config();
+	if (e)
+	{
+		fileConfig = retdec::config::Config::fromFile(configPath.string());
+		fileConfig.parameters.fixRelativePaths(idaPath.string());
+	}
+	loaded = true;
+	exists = e;
+	time = t;
+	return fileConfig;
+}
+
+/**
+ * @param fileChanged If not \c nullptr, set to \c true if the decompiler
+ *                    config file changed since the last call.
+ */
+bool generateHeader(
+		retdec::config::Config& config,
+		std::string out,
+		bool* fileChanged = nullptr)
+{
+	Profiler::Phase phase("config.header");
 	auto inFile = getInputPath();
 	if (inFile.empty())
 	{
@@ -199,16 +248,18 @@ bool generateHeader(retdec::config::Config& config, std::string out)
 		return true;
 	}
 
-	auto idaPath = retdec::utils::getThisBinaryDirectoryPath();
-	auto configPath = idaPath;
-	configPath.append("plugins");
-	configPath.append("retdec");
-	configPath.append("decompiler-config.json");
-	if (fs::exists(configPath))
+	// Only decompilation parameters are read from the file. The rest of the
+	// config (functions, globals, ...) is kept, it may be reused by
+	// IncrementalConfig.
+	bool changed = false;
+	auto& fileConfig = getFileConfig(changed);
+	if (fileChanged)
 	{
-		config = retdec::config::Config::fromFile(configPath.string());
-		config.parameters.fixRelativePaths(idaPath.string());
+		*fileChanged = changed;
 	}
+	config.parameters = fileConfig.parameters;
+	config.architecture = fileConfig.architecture;
+	config.fileFormat = fileConfig.fileFormat;
 
 	if (!arch.empty())
 	{
@@ -663,7 +714,16 @@ void generateFunctionType(
 	}
 }
 
-void generateFunction(
+std::string sanitizeFunctionName(std::string name)
+{
+	std::replace(name.begin(), name.end(), '.', '_');
+	return name;
+}
+
+/**
+ * Returns name of the generated function.
+ */
+std::string generateFunction(
 		retdec::config::Config& config,
 		std::map<tinfo_t, std::string>& structIdSet,
 		func_t* fnc)
@@ -671,8 +731,7 @@ void generateFunction(
 	qstring qFncName;
 	get_func_name(&qFncName, fnc->start_ea);
 
-	std::string fncName = qFncName.c_str();
-	std::replace(fncName.begin(), fncName.end(), '.', '_');
+	std::string fncName = sanitizeFunctionName(qFncName.c_str());
 
 	retdec::common::Function ccFnc(fncName);
 	ccFnc.setStart(fnc->start_ea);
@@ -732,21 +791,15 @@ void generateFunction(
 	}
 
 	config.functions.insert(ccFnc);
+	return fncName;
 }
 
-void generateFunctions(
-		retdec::config::Config& config,
-		std::map<tinfo_t, std::string>& structIdSet)
-{
-	for (unsigned i = 0; i < get_func_qty(); ++i)
-	{
-		generateFunction(config, structIdSet, getn_func(i));
-	}
-}
-
-void generateGlobals(
-		retdec::config::Config& config,
-		std::map<tinfo_t, std::string>& structIdSet)
+/**
+ * Call \p fnc for all the heads in the given range that lie in segments which
+ * may contain global objects.
+ */
+template <typename F>
+void forEachGlobalHead(ea_t start, ea_t end, F fnc)
 {
 	qstring buff;
 
@@ -759,103 +812,268 @@ void generateGlobals(
 			continue;
 		}
 
-		if (get_visible_segm_name(&buff, seg) <= 0)
+		ea_t s = std::max(start, seg->start_ea);
+		ea_t e = std::min(end, seg->end_ea);
+		if (s >= e)
 		{
 			continue;
 		}
 
-		ea_t head = seg->start_ea - 1;
-		while ( (head = next_head(head, seg->end_ea)) != BADADDR)
+		if (get_visible_segm_name(&buff, seg) <= 0)
 		{
-			flags_t f = get_full_flags(head);
-			if (f == 0)
-			{
-				continue;
-			}
+			continue;
+		}
 
-			// Argument 1 should not be present for data.
-			// Some object do have argument 0 (off_X), some dont (strings).
-			//
-			if (!is_data(f) || !is_head(f) || /*!is_defarg0(f) ||*/ is_defarg1(f))
-			{
-				continue;
-			}
+		ea_t head = is_head(get_flags(s)) ? s : next_head(s, e);
+		for (; head != BADADDR && head < e; head = next_head(head, e))
+		{
+			fnc(head);
+		}
+	}
+}
 
-			if (!has_any_name(f)) // usually alignment.
-			{
-				continue;
-			}
+/**
+ * Generate global variable, or dynamically linked function, at the given head.
+ * Returns name of the generated object, empty string if nothing was generated.
+ * @param isFunction Set to \c true if function was generated.
+ */
+std::string generateGlobal(
+		retdec::config::Config& config,
+		std::map<tinfo_t, std::string>& structIdSet,
+		ea_t head,
+		bool& isFunction)
+{
+	isFunction = false;
 
-			if (get_name(&buff, head) <= 0)
-			{
-				continue;
-			}
+	flags_t f = get_full_flags(head);
+	if (f == 0)
+	{
+		return std::string();
+	}
 
-			auto s = retdec::common::Storage::inMemory(
-					retdec::common::Address(head));
-			retdec::common::Object global(buff.c_str(), s);
+	// Argument 1 should not be present for data.
+	// Some object do have argument 0 (off_X), some dont (strings).
+	//
+	if (!is_data(f) || !is_head(f) || /*!is_defarg0(f) ||*/ is_defarg1(f))
+	{
+		return std::string();
+	}
 
-			// Get type.
-			//
-			tinfo_t getType;
-			get_tinfo(&getType, head);
+	if (!has_any_name(f)) // usually alignment.
+	{
+		return std::string();
+	}
 
-			if (!getType.empty() && getType.present() && getType.is_func())
-			{
-				if (config.functions.getFunctionByStartAddress(head) != nullptr)
-				{
-					continue;
-				}
+	qstring buff;
+	if (get_name(&buff, head) <= 0)
+	{
+		return std::string();
+	}
 
-				std::string fncName = buff.c_str();
-				std::replace(fncName.begin(), fncName.end(), '.', '_');
+	auto s = retdec::common::Storage::inMemory(
+			retdec::common::Address(head));
+	retdec::common::Object global(buff.c_str(), s);
 
-				retdec::common::Function ccFnc(fncName);
-				ccFnc.setStart(head);
-				ccFnc.setEnd(head);
-				ccFnc.setIsDynamicallyLinked();
-				generateFunctionType(config, structIdSet, getType, ccFnc);
+	// Get type.
+	//
+	tinfo_t getType;
+	get_tinfo(&getType, head);
 
-				qstring qDemangled;
-				if (demangle_name(&qDemangled, fncName.c_str(), MNG_SHORT_FORM) > 0)
-				{
-					ccFnc.setDemangledName(qDemangled.c_str());
-				}
+	if (!getType.empty() && getType.present() && getType.is_func())
+	{
+		if (config.functions.getFunctionByStartAddress(head) != nullptr)
+		{
+			return std::string();
+		}
 
-				config.functions.insert(ccFnc);
-				continue;
-			}
+		std::string fncName = sanitizeFunctionName(buff.c_str());
 
-			// Continue creating global variable.
-			//
-			if (!getType.empty() && getType.present())
-			{
-				global.type.setLlvmIr(type2string(config, structIdSet, getType));
-			}
-			else
-			{
-				global.type.setLlvmIr(addrType2string(head));
-			}
+		retdec::common::Function ccFnc(fncName);
+		ccFnc.setStart(head);
+		ccFnc.setEnd(head);
+		ccFnc.setIsDynamicallyLinked();
+		generateFunctionType(config, structIdSet, getType, ccFnc);
 
-			config.globals.insert(global);
+		qstring qDemangled;
+		if (demangle_name(&qDemangled, fncName.c_str(), MNG_SHORT_FORM) > 0)
+		{
+			ccFnc.setDemangledName(qDemangled.c_str());
 		}
+
+		config.functions.insert(ccFnc);
+		isFunction = true;
+		return fncName;
 	}
+
+	// Continue creating global variable.
+	//
+	if (!getType.empty() && getType.present())
+	{
+		global.type.setLlvmIr(type2string(config, structIdSet, getType));
+	}
+	else
+	{
+		global.type.setLlvmIr(addrType2string(head));
+	}
+
+	config.globals.insert(global);
+	return buff.c_str();
 }
 
-bool fillConfig(retdec::config::Config& config, const std::string& out)
+//
+//==============================================================================
+// IncrementalConfig
+//==============================================================================
+//
+
+bool IncrementalConfig::fill(
+		retdec::config::Config& config,
+		const std::string& out)
 {
-	std::map<tinfo_t, std::string> structIdSet;
+	Profiler::Phase phase("config");
+	bool fileChanged = false;
+	if (generateHeader(config, out, &fileChanged))
+	{
+		return true;
+	}
+	if (fileChanged || out != _out)
+	{
+		_out = out;
+		++_generation;
+	}
 
+	if (_valid)
+	{
+		Profiler::Phase phase("config.update");
+		if (!_invalid.empty())
+		{
+			++_generation;
+		}
+		for (auto& r : _invalid)
+		{
+			update(config, r.first, r.second);
+		}
+		_invalid.clear();
+		return false;
+	}
+
+	_structIdSet.clear();
+	_functions.clear();
+	_globals.clear();
+	_invalid.clear();
 	config.structures.clear();
 	config.functions.clear();
 	config.globals.clear();
 
-	if (generateHeader(config, out))
 	{
-		return true;
+		Profiler::Phase phase("config.full");
+		for (unsigned i = 0; i < get_func_qty(); ++i)
+		{
+			generateFunction(config, getn_func(i));
+		}
+		generateGlobals(config, 0, BADADDR);
 	}
-	generateFunctions(config, structIdSet);
-	generateGlobals(config, structIdSet);
 
+	_valid = true;
+	++_generation;
 	return false;
 }
+
+void IncrementalConfig::invalidate()
+{
+	_valid = false;
+	_invalid.clear();
+}
+
+void IncrementalConfig::invalidate(ea_t start, ea_t end)
+{
+	if (!_valid || start >= end)
+	{
+		return;
+	}
+
+	_invalid.insert({start, end});
+	if (_invalid.size() > _maxInvalid)
+	{
+		invalidate();
+	}
+}
+
+void IncrementalConfig::invalidate(ea_t ea)
+{
+	invalidate(ea, ea + 1);
+}
+
+void IncrementalConfig::update(
+		retdec::config::Config& config,
+		ea_t start,
+		ea_t end)
+{
+	// Remove old objects.
+	//
+	for (auto it = _functions.lower_bound(start);
+			it != _functions.end() && it->first < end;
+			it = _functions.erase(it))
+	{
+		if (auto* f = config.functions.getFunctionByName(it->second))
+		{
+			config.functions.erase(*f);
+		}
+	}
+	for (auto it = _globals.lower_bound(start);
+			it != _globals.end() && it->first < end;
+			it = _globals.erase(it))
+	{
+		if (auto* g = config.globals.getObjectByName(it->second))
+		{
+			config.globals.erase(*g);
+		}
+	}
+
+	// Generate new objects.
+	//
+	func_t* f = get_func(start);
+	if (f && f->start_ea == start)
+	{
+		generateFunction(config, f);
+	}
+	for (f = get_next_func(start);
+			f && f->start_ea < end;
+			f = get_next_func(f->start_ea))
+	{
+		generateFunction(config, f);
+	}
+
+	generateGlobals(config, start, end);
+}
+
+void IncrementalConfig::generateFunction(
+		retdec::config::Config& config,
+		func_t* f)
+{
+	_functions[f->start_ea] = ::generateFunction(config, _structIdSet, f);
+}
+
+void IncrementalConfig::generateGlobals(
+		retdec::config::Config& config,
+		ea_t start,
+		ea_t end)
+{
+	forEachGlobalHead(start, end, [&](ea_t head)
+	{
+		bool isFunction = false;
+		auto name = generateGlobal(config, _structIdSet, head, isFunction);
+		if (name.empty())
+		{
+			return;
+		}
+		if (isFunction)
+		{
+			_functions[head] = name;
+		}
+		else
+		{
+			_globals[head] = name;
+		}
+	});
+}
@@ -2,11 +2,73 @@
 #ifndef RETDEC_CONFIG_H
 #define RETDEC_CONFIG_H
 
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
 #include <retdec/config/config.h>
 
+#include "utils.h"
+
+/**
+ * Replace characters that can not be in config function names.
+ */
+std::string sanitizeFunctionName(std::string name);
+
 /**
- * Returns \c true if something went wrong.
+ * Decompilation config kept in sync with IDB.
+ *
+ * The config is generated in full only the first time (or after changes that
+ * can not be tracked), then only the addresses invalidated by IDB events
+ * (see idbListener_t) are regenerated.
  */
-bool fillConfig(retdec::config::Config& config, const std::string& out = "");
+class IncrementalConfig
+{
+	public:
+		/// Fill the config with the decompilation parameters, functions,
+		/// globals and structures of IDB for the output file \p out.
+		/// Only the invalidated parts are regenerated after the first call,
+		/// the same config object must be used in all the calls.
+		/// Returns \c true if something went wrong.
+		bool fill(retdec::config::Config& config, const std::string& out = "");
+
+		/// Regenerate the entire config on the next fill().
+		void invalidate();
+		/// Regenerate objects starting in the given address range.
+		void invalidate(ea_t start, ea_t end);
+		/// Regenerate objects starting at the given address.
+		void invalidate(ea_t ea);
+
+		/// Changes whenever fill() produces a different config. Configs
+		/// filled in the same generation are the same, which lets the
+		/// decompilation worker processes keep it between decompilations.
+		std::uint64_t generation() const { return _generation; }
+
+	private:
+		void update(retdec::config::Config& config, ea_t start, ea_t end);
+		void generateFunction(retdec::config::Config& config, func_t* f);
+		void generateGlobals(
+				retdec::config::Config& config,
+				ea_t start,
+				ea_t end
+		);
+
+	private:
+		bool _valid = false;
+		std::uint64_t _generation = 1;
+		/// Output file of the last fill().
+		std::string _out;
+		std::map<tinfo_t, std::string> _structIdSet;
+		/// Address ranges to regenerate.
+		std::set<std::pair<ea_t, ea_t>> _invalid;
+		/// Start addresses and names of the generated functions and globals.
+		/// Config containers are not indexed by addresses.
+		std::map<ea_t, std::string> _functions;
+		std::map<ea_t, std::string> _globals;
+
+		/// Regenerate everything if there are more invalidated ranges.
+		inline static const std::size_t _maxInvalid = 10000;
+};
 
 #endif
@@ -0,0 +1,85 @@
+
+#include <mutex>
+#include <stdexcept>
+
+#include <retdec/retdec/retdec.h>
+
+#include "decompilation.h"
+
+bool runDecompilation(
+		retdec::config::Config& config,
+		std::string* output,
+		std::string& error)
+{
+	// Shared by all the threads and plugin instances in this process,
+	// including a worker thread left running by a closed IDB.
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	try
+	{
+		auto rc = retdec::decompile(config, output);
+		if (rc != 0)
+		{
+			throw std::runtime_error(
+					"decompilation error code = " + std::to_string(rc)
+			);
+		}
+	}
+	catch (const std::runtime_error& e)
+	{
+		error = e.what();
+		return true;
+	}
+	catch (...)
+	{
+		error = "unknown";
+		return true;
+	}
+
+	return false;
+}
+
+void selectRanges(retdec::config::Config& config, const AddressRanges& ranges)
+{
+	config.parameters.selectedRanges.clear();
+	for (auto& r : ranges)
+	{
+		retdec::common::AddressRange range(r.first, r.second);
+		config.parameters.selectedRanges.insert(range);
+	}
+	config.parameters.setIsSelectedDecodeOnly(true);
+}
+
+void selectRange(
+		retdec::config::Config& config,
+		std::uint64_t start,
+		std::uint64_t end)
+{
+	config.parameters.setOutputFormat("json");
+	selectRanges(config, {{start, end}});
+}
+
+namespace protocol {
+
+std::string encodeSize(std::uint64_t size)
+{
+	std::string ret(sizeLength, '\0');
+	for (std::size_t i = 0; i < sizeLength; ++i)
+	{
+		ret[i] = static_cast<char>((size >> (8 * i)) & 0xff);
+	}
+	return ret;
+}
+
+std::uint64_t decodeSize(const char* bytes)
+{
+	std::uint64_t ret = 0;
+	for (std::size_t i = 0; i < sizeLength; ++i)
+	{
+		ret |= std::uint64_t(static_cast<unsigned char>(bytes[i])) << (8 * i);
+	}
+	return ret;
+}
+
+} // namespace protocol
@@ -0,0 +1,87 @@
+
+#ifndef RETDEC_DECOMPILATION_H
+#define RETDEC_DECOMPILATION_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+// Nothing in here may use IDA API - it is shared by the plugin and the
+// decompilation worker executable.
+
+/**
+ * Run RetDec decompilation with the given config.
+ * Does not touch IDA API, therefore it can be used from any thread.
+ * RetDec keeps global state (LLVM), calls from multiple threads are therefore
+ * serialized - the call waits until the running decompilation finishes.
+ * @param config Decompilation config.
+ * @param output If not \c nullptr, decompilation output is stored here.
+ * @param error  Set to the failure reason if something went wrong.
+ * @return \c true if something went wrong.
+ */
+bool runDecompilation(
+		retdec::config::Config& config,
+		std::string* output,
+		std::string& error
+);
+
+/// Address ranges [start, end) selected for decompilation.
+using AddressRanges = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+
+/**
+ * Make the config decompile only the given address ranges (the previously
+ * selected ranges are dropped). Output format is not changed.
+ */
+void selectRanges(retdec::config::Config& config, const AddressRanges& ranges);
+
+/**
+ * Make the config decompile only the given address range into JSON output.
+ */
+void selectRange(
+		retdec::config::Config& config,
+		std::uint64_t start,
+		std::uint64_t end
+);
+
+/**
+ * Protocol between the plugin and the decompilation worker process.
+ *
+ * Both requests and responses are messages: payload size (8 bytes, little
+ * endian) followed by the payload. Request payload starts with a request
+ * character:
+ *   - requestConfig followed by the JSON config of the whole input. Worker
+ *     keeps it until the next requestConfig, so that it is not generated,
+ *     transferred, and parsed again for every function.
+ *   - requestDecompile followed by the start and end addresses (8 bytes
+ *     each, encoded the same way as sizes) of the address ranges to
+ *     decompile with the kept config, no ranges = the whole input. Output
+ *     format (and file) is the one in the kept config.
+ * Response payload starts with a status character (responseOk or
+ * responseError) and the peak resident set size of the worker in bytes
+ * (encoded as sizes), followed by the decompilation output (empty for
+ * requestConfig) or the error message. Payloads are at most maxPayloadSize
+ * bytes long.
+ * Worker exits when its input is closed.
+ */
+namespace protocol {
+
+const std::size_t sizeLength = 8;
+const char requestConfig = 'c';
+const char requestDecompile = 'd';
+const char responseOk = '0';
+const char responseError = '1';
+/// Larger messages are rejected as corrupted, instead of allocating memory
+/// for them.
+const std::uint64_t maxPayloadSize = std::uint64_t(2) * 1024 * 1024 * 1024;
+
+/// Encode payload size into sizeLength bytes.
+std::string encodeSize(std::uint64_t size);
+/// Decode payload size from sizeLength bytes.
+std::uint64_t decodeSize(const char* bytes);
+
+} // namespace protocol
+
+#endif
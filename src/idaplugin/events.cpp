@@ -0,0 +1,135 @@
+
+#include "events.h"
+#include "retdec.h"
+
+idbListener_t::idbListener_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+ssize_t idaapi idbListener_t::on_event(ssize_t code, va_list va)
+{
+	auto& cfg = plg.incrementalConfig;
+	auto& names = plg.functionNames;
+
+	switch (code)
+	{
+		case idb_event::renamed:
+		{
+			ea_t ea = va_arg(va, ea_t);
+			cfg.invalidate(ea);
+			names.update(ea);
+			break;
+		}
+
+		case idb_event::func_added:
+		{
+			func_t* pfn = va_arg(va, func_t*);
+			cfg.invalidate(pfn->start_ea);
+			names.update(pfn->start_ea);
+			// Function created again at the same address.
+			plg.forgetDecompiledFunction(pfn);
+			break;
+		}
+
+		case idb_event::func_updated:
+		{
+			func_t* pfn = va_arg(va, func_t*);
+			cfg.invalidate(pfn->start_ea);
+			break;
+		}
+
+		case idb_event::deleting_func:
+		{
+			func_t* pfn = va_arg(va, func_t*);
+			cfg.invalidate(pfn->start_ea);
+			names.remove(pfn->start_ea);
+			plg.forgetDecompiledFunction(pfn);
+			break;
+		}
+
+		case idb_event::set_func_start:
+		{
+			func_t* pfn = va_arg(va, func_t*);
+			ea_t newStart = va_arg(va, ea_t);
+			cfg.invalidate(pfn->start_ea);
+			cfg.invalidate(newStart);
+			// Sent before the change, the index is rebuilt on demand.
+			names.invalidate();
+			plg.forgetDecompiledFunction(pfn);
+			IdbCache::remove(newStart);
+			break;
+		}
+
+		case idb_event::set_func_end:
+		{
+			func_t* pfn = va_arg(va, func_t*);
+			cfg.invalidate(pfn->start_ea);
+			plg.forgetDecompiledFunction(pfn);
+			break;
+		}
+
+		case idb_event::ti_changed:
+		{
+			ea_t ea = va_arg(va, ea_t);
+			cfg.invalidate(ea);
+			break;
+		}
+
+		// Function comments.
+		case idb_event::range_cmt_changed:
+		{
+			range_kind_t kind = range_kind_t(va_arg(va, int));
+			const range_t* a = va_arg(va, const range_t*);
+			if (kind == RANGE_KIND_FUNC)
+			{
+				cfg.invalidate(a->start_ea);
+			}
+			break;
+		}
+
+		// Linked function detection depends on function's instructions.
+		case idb_event::make_code:
+		{
+			const insn_t* insn = va_arg(va, const insn_t*);
+			if (func_t* pfn = get_func(insn->ea))
+			{
+				cfg.invalidate(pfn->start_ea);
+			}
+			break;
+		}
+
+		case idb_event::make_data:
+		{
+			ea_t ea = va_arg(va, ea_t);
+			cfg.invalidate(ea);
+			break;
+		}
+
+		case idb_event::destroyed_items:
+		{
+			ea_t ea1 = va_arg(va, ea_t);
+			ea_t ea2 = va_arg(va, ea_t);
+			cfg.invalidate(ea1, ea2);
+			break;
+		}
+
+		// Changes that can not be tracked by addresses.
+		case idb_event::local_types_changed:
+		case idb_event::segm_added:
+		case idb_event::segm_deleted:
+		case idb_event::segm_start_changed:
+		case idb_event::segm_end_changed:
+		case idb_event::segm_moved:
+		case idb_event::allsegs_moved:
+		case idb_event::closebase:
+		{
+			cfg.invalidate();
+			names.invalidate();
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef RETDEC_EVENTS_H
+#define RETDEC_EVENTS_H
+
+#include "utils.h"
+
+class RetDec;
+
+/**
+ * IDB events listener.
+ * Keeps plugin's data derived from IDB (e.g. decompilation config) up to date.
+ */
+struct idbListener_t : public event_listener_t
+{
+	RetDec& plg;
+	idbListener_t(RetDec& p);
+
+	virtual ssize_t idaapi on_event(ssize_t code, va_list va) override;
+};
+
+#endif
@@ -1,5 +1,7 @@
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 
 #include "function.h"
 
@@ -11,15 +13,60 @@ Function::Function()
 Function::Function(func_t* f, const std::vector<Token>& tokens)
 		: _fnc(f)
 {
+	_tokens.reserve(tokens.size());
+	_yxs.reserve(tokens.size());
+
+	std::vector<std::pair<ea_t, YX>> eas;
+	eas.reserve(tokens.size());
+
+	// Most of the values (white spaces, punctuation, types, variables)
+	// repeat, store each of them only once. The views into _text stay
+	// valid, it never needs more than all the values.
+	std::size_t textSize = 0;
+	for (auto& t : tokens)
+	{
+		textSize += t.value.size();
+	}
+	_text.reserve(textSize);
+	std::unordered_map<std::string_view, std::uint32_t> offsets;
+	offsets.reserve(tokens.size() / 8);
+
 	std::size_t y = YX::starting_y;
 	std::size_t x = YX::starting_x;
 	for (auto& t : tokens)
 	{
-		_tokens[YX(y, x)] = t;
+		YX yx(y, x);
+		eas.emplace_back(t.ea, yx);
+
+		TokenData d;
+		d.ea = t.ea;
+		d.kind = t.kind;
+		d.size = t.value.size();
+		auto it = offsets.find(t.value);
+		if (it == offsets.end())
+		{
+			d.offset = _text.size();
+			_text += t.value;
+			offsets.emplace(text(d), d.offset);
+		}
+		else
+		{
+			d.offset = it->second;
+		}
 
-		if (_ea2yx.count(t.ea) == 0)
+		// Empty token shares YX with the next one, which replaces it.
+		if (!_yxs.empty() && _yxs.back() == yx)
 		{
-			_ea2yx[t.ea] = YX(y, x);
+			_tokens.back() = d;
+		}
+		else
+		{
+			if (_lines.size() <= y - YX::starting_y)
+			{
+				_lines.push_back(_tokens.size());
+			}
+			_tokens.push_back(d);
+			_yxs.push_back(yx);
 		}
 
 		if (t.kind == Token::Kind::NEW_LINE)
@@ -32,6 +79,26 @@ Function::Function(func_t* f, const std::vector<Token>& tokens)
 			x += t.value.size();
 		}
 	}
+	_lines.push_back(_tokens.size());
+	_text.shrink_to_fit();
+
+	// Keep only the first YX for each address.
+	std::stable_sort(eas.begin(), eas.end(),
+			[](const auto& a, const auto& b) { return a.first < b.first; });
+	eas.erase(std::unique(eas.begin(), eas.end(),
+			[](const auto& a, const auto& b) { return a.first == b.first; }),
+			eas.end());
+	_ea2yx.assign(eas.begin(), eas.end());
+}
+
+Function Function::placeholder(func_t* f, const std::string& comment)
+{
+	Function ret(f, {
+			Token(Token::Kind::COMMENT, f->start_ea, comment),
+			Token(Token::Kind::NEW_LINE, f->start_ea, "\n")
+	});
+	ret._placeholder = true;
+	return ret;
 }
 
 func_t* Function::fnc() const
@@ -56,108 +123,279 @@ ea_t Function::getEnd() const
 	return _fnc->end_ea;
 }
 
-const Token* Function::getToken(YX yx) const
+std::optional<Token> Function::getToken(YX yx) const
+{
+	auto i = tokenIndex(yx);
+	if (i == npos)
+	{
+		return std::nullopt;
+	}
+	auto& t = _tokens[i];
+	return Token(t.kind, t.ea, std::string(text(t)));
+}
+
+std::vector<Token> Function::getTokens() const
+{
+	std::vector<Token> ret;
+	ret.reserve(_tokens.size());
+	for (auto& t : _tokens)
+	{
+		ret.emplace_back(t.kind, t.ea, std::string(text(t)));
+	}
+	return ret;
+}
+
+std::size_t Function::tokenCount() const
+{
+	return _tokens.size();
+}
+
+Token::Kind Function::tokenKind(std::size_t i) const
 {
-	auto it = _tokens.find(adjust_yx(yx));
-	return it == _tokens.end() ? nullptr : &it->second;
+	return _tokens[i].kind;
 }
 
-const std::map<YX, Token>& Function::getTokens() const
+std::string_view Function::tokenValue(std::size_t i) const
 {
-	return _tokens;
+	return text(_tokens[i]);
+}
+
+std::string_view Function::text(const TokenData& t) const
+{
+	return std::string_view(_text.data() + t.offset, t.size);
 }
 
 YX Function::min_yx() const
 {
-	return _tokens.empty() ? YX::starting_yx : _tokens.begin()->first;
+	return _yxs.empty() ? YX::starting_yx : _yxs.front();
 }
 
 YX Function::max_yx() const
 {
-	return _tokens.empty() ? YX::starting_yx : _tokens.rbegin()->first;
+	return _yxs.empty() ? YX::starting_yx : _yxs.back();
 }
 
 YX Function::prev_yx(YX yx) const
 {
-	auto it = _tokens.find(adjust_yx(yx));
-	if (it == _tokens.end() || it == _tokens.begin())
+	auto i = tokenIndex(yx);
+	if (i == npos || i == 0)
 	{
 		return yx;
 	}
-	--it;
-	return it->first;
+	return _yxs[i - 1];
 }
 
 YX Function::next_yx(YX yx) const
 {
-	auto it = _tokens.find(adjust_yx(yx));
-	auto nit = it;
-	++nit;
-	if (it == _tokens.end() || nit == _tokens.end())
+	auto i = tokenIndex(yx);
+	if (i == npos || i + 1 >= _yxs.size())
 	{
 		return yx;
 	}
-	return nit->first;
+	return _yxs[i + 1];
 }
 
 YX Function::adjust_yx(YX yx) const
 {
-	if (_tokens.empty() || _tokens.count(yx))
-	{
-		return yx;
-	}
-	if (yx <= min_yx())
+	auto i = tokenIndex(yx);
+	return i == npos ? yx : _yxs[i];
+}
+
+std::size_t Function::tokenIndex(YX yx) const
+{
+	if (_tokens.empty() || yx < _yxs.front())
 	{
-		return min_yx();
+		return _tokens.empty() ? npos : 0;
 	}
-	if (yx >= max_yx())
+
+	std::size_t line = yx.y - YX::starting_y;
+	if (line + 1 >= _lines.size())
 	{
-		return max_yx();
+		return _tokens.size() - 1;
 	}
 
-	auto it = _tokens.upper_bound(yx);
-	--it;
-	return it->first;
+	// The last token on the line starting before (or at) yx.x.
+	// Every line starts at x = 0, so there always is one.
+	auto b = _yxs.begin() + _lines[line];
+	auto e = _yxs.begin() + _lines[line + 1];
+	auto it = std::upper_bound(b, e, yx.x,
+			[](std::size_t x, const YX& t) { return x < t.x; });
+	return std::max<std::size_t>(it - _yxs.begin(), 1) - 1;
 }
 
 std::string Function::line_yx(YX yx) const
 {
 	std::string line;
 
-	auto it = _tokens.find(adjust_yx(yx));
-	while (it != _tokens.end()
-			&& it->first.y == yx.y
-			&& it->second.kind != Token::Kind::NEW_LINE)
+	auto i = tokenIndex(yx);
+	for (; i < _tokens.size()
+			&& _yxs[i].y == yx.y
+			&& _tokens[i].kind != Token::Kind::NEW_LINE;
+			++i)
 	{
-		line += std::string(SCOLOR_ON)
-				+ it->second.getColorTag()
-				+ it->second.value
-				+ SCOLOR_OFF
-				+ it->second.getColorTag();
-		++it;
+		appendColored(line, _tokens[i]);
 	}
 
 	return line;
 }
 
-ea_t Function::yx_2_ea(YX yx) const
+const qstring& Function::coloredLine(std::size_t y) const
 {
-	auto it = _tokens.find(adjust_yx(yx));
-	if (it == _tokens.end())
+	static const qstring empty;
+
+	if (_coloredLines.empty() && !_tokens.empty())
 	{
-		return BADADDR;
+		_coloredLines.resize(_lines.size() - 1);
+		for (std::size_t l = 0; l + 1 < _lines.size(); ++l)
+		{
+			renderLine(l);
+		}
 	}
-	return it->second.ea;
+
+	std::size_t l = y - YX::starting_y;
+	if (y < YX::starting_y || l >= _coloredLines.size())
+	{
+		return empty;
+	}
+	return _coloredLines[l];
+}
+
+void Function::renderLine(std::size_t l) const
+{
+	qstring& line = _coloredLines[l];
+	line.qclear();
+	for (auto i = _lines[l]; i < _lines[l + 1]; ++i)
+	{
+		if (_tokens[i].kind != Token::Kind::NEW_LINE)
+		{
+			appendColored(line, _tokens[i]);
+		}
+	}
+}
+
+std::vector<std::size_t> Function::findTokens(
+		Token::Kind k,
+		const std::string& value) const
+{
+	std::vector<std::size_t> ret;
+	for (std::size_t i = 0; i < _tokens.size(); ++i)
+	{
+		if (_tokens[i].kind == k && text(_tokens[i]) == value)
+		{
+			ret.push_back(i);
+		}
+	}
+	return ret;
+}
+
+std::vector<std::size_t> Function::renameTokens(
+		const std::vector<std::size_t>& indexes,
+		Token::Kind k,
+		const std::string& oldVal,
+		const std::string& newVal)
+{
+	// Lines (indexes into _lines) of the renamed tokens.
+	std::vector<std::size_t> renamed;
+	std::vector<std::size_t> lines;
+	std::uint32_t offset = _text.size();
+	for (auto i : indexes)
+	{
+		if (i < _tokens.size()
+				&& _tokens[i].kind == k
+				&& text(_tokens[i]) == oldVal)
+		{
+			_tokens[i].offset = offset;
+			_tokens[i].size = newVal.size();
+			renamed.push_back(i);
+			lines.push_back(_yxs[i].y - YX::starting_y);
+		}
+	}
+	if (renamed.empty())
+	{
+		return renamed;
+	}
+	_text += newVal;
+	_generation = ++_lastGeneration;
+	std::sort(lines.begin(), lines.end());
+	lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+	// Lay out the lines again, remember the old columns.
+	std::vector<std::vector<std::size_t>> oldXs(lines.size());
+	for (std::size_t li = 0; li < lines.size(); ++li)
+	{
+		auto l = lines[li];
+		std::size_t x = YX::starting_x;
+		for (auto i = _lines[l]; i < _lines[l + 1]; ++i)
+		{
+			oldXs[li].push_back(_yxs[i].x);
+			_yxs[i].x = x;
+			x += _tokens[i].size;
+		}
+		if (!_coloredLines.empty())
+		{
+			renderLine(l);
+		}
+	}
+
+	// Move the address mappings pointing into the changed lines. The order
+	// of tokens on a line does not change, so the first YX of each address
+	// stays the first one.
+	for (auto& p : _ea2yx)
+	{
+		auto l = p.second.y - YX::starting_y;
+		auto lit = std::lower_bound(lines.begin(), lines.end(), l);
+		if (lit == lines.end() || *lit != l)
+		{
+			continue;
+		}
+		auto& xs = oldXs[lit - lines.begin()];
+		auto xit = std::lower_bound(xs.begin(), xs.end(), p.second.x);
+		if (xit != xs.end() && *xit == p.second.x)
+		{
+			p.second = _yxs[_lines[l] + (xit - xs.begin())];
+		}
+	}
+
+	return renamed;
+}
+
+void Function::appendColored(qstring& line, const TokenData& t) const
+{
+	const char* color = Token::getColorTag(t.kind);
+	line.append(SCOLOR_ON);
+	line.append(color);
+	line.append(_text.data() + t.offset, t.size);
+	line.append(SCOLOR_OFF);
+	line.append(color);
+}
+
+void Function::appendColored(std::string& line, const TokenData& t) const
+{
+	const char* color = Token::getColorTag(t.kind);
+	line += SCOLOR_ON;
+	line += color;
+	line += text(t);
+	line += SCOLOR_OFF;
+	line += color;
+}
+
+ea_t Function::yx_2_ea(YX yx) const
+{
+	auto i = tokenIndex(yx);
+	return i == npos ? BADADDR : _tokens[i].ea;
 }
 
 std::set<ea_t> Function::yx_2_eas(YX yx) const
 {
 	std::set<ea_t> ret;
-	auto it = _tokens.find(YX(yx.y, 0));
-	while (it != _tokens.end() && it->first.y == yx.y)
+	std::size_t line = yx.y - YX::starting_y;
+	if (yx.y < YX::starting_y || line + 1 >= _lines.size())
+	{
+		return ret;
+	}
+	for (auto i = _lines[line]; i < _lines[line + 1]; ++i)
 	{
-		ret.insert(it->second.ea);
-		++it;
+		ret.insert(_tokens[i].ea);
 	}
 	return ret;
 }
@@ -168,16 +406,17 @@ YX Function::ea_2_yx(ea_t ea) const
 	{
 		return YX::starting_yx;
 	}
-	if (ea < _ea2yx.begin()->first || _ea2yx.rbegin()->first < ea)
+	if (ea < _ea2yx.front().first || _ea2yx.back().first < ea)
 	{
 		return YX::starting_yx;
 	}
-	if (ea == _ea2yx.rbegin()->first)
+	if (ea == _ea2yx.back().first)
 	{
 		return max_yx();
 	}
 
-	auto it = _ea2yx.upper_bound(ea);
+	auto it = std::upper_bound(_ea2yx.begin(), _ea2yx.end(), ea,
+			[](ea_t a, const auto& p) { return a < p.first; });
 	--it;
 	return it->second;
 }
@@ -187,20 +426,60 @@ bool Function::ea_inside(ea_t ea) const
 	return getStart() <= ea && ea < getEnd();
 }
 
+bool Function::isPlaceholder() const
+{
+	return _placeholder;
+}
+
+std::size_t Function::memoryUsage() const
+{
+	// Each colored token is wrapped in COLOR_ON and COLOR_OFF tags.
+	static const std::size_t colorTags = 4;
+
+	std::size_t ret = _tokens.capacity() * sizeof(TokenData)
+			+ _yxs.capacity() * sizeof(YX)
+			+ _text.capacity()
+			+ _lines.capacity() * sizeof(std::size_t)
+			+ _ea2yx.capacity() * sizeof(_ea2yx[0])
+			+ _lines.size() * sizeof(qstring);
+	for (auto& t : _tokens)
+	{
+		ret += t.size + colorTags;
+	}
+	return ret;
+}
+
+void Function::release()
+{
+	func_t* f = _fnc;
+	*this = Function();
+	_fnc = f;
+	_released = true;
+}
+
+bool Function::isReleased() const
+{
+	return _released;
+}
+
+std::uint64_t Function::generation() const
+{
+	return _generation;
+}
+
 std::vector<std::pair<std::string, ea_t>> Function::toLines() const
 {
 	std::vector<std::pair<std::string, ea_t>> lines;
 
 	ea_t addr = BADADDR;
 	std::string line;
-	for (auto& p : _tokens)
+	for (auto& t : _tokens)
 	{
 		if (addr == BADADDR)
 		{
-			addr = p.second.ea;
+			addr = t.ea;
 		}
 
-		auto& t = p.second;
 		if (t.kind == Token::Kind::NEW_LINE)
 		{
 			lines.emplace_back(std::make_pair(line, addr));
@@ -209,7 +488,7 @@ std::vector<std::pair<std::string, ea_t>> Function::toLines() const
 		}
 		else
 		{
-			line += t.value;
+			line += text(t);
 		}
 	}
 
@@ -229,3 +508,110 @@ std::ostream& operator<<(std::ostream& os, const Function& f)
 			<< "," << f.getEnd() << ")";
 	return os;
 }
+
+//
+//==============================================================================
+// IdentifierIndex
+//==============================================================================
+//
+
+bool IdentifierIndex::isIndexed(Token::Kind k)
+{
+	return k == Token::Kind::ID_FNC || k == Token::Kind::ID_GVAR;
+}
+
+std::string IdentifierIndex::key(Token::Kind k, std::string_view value)
+{
+	std::string ret(1, char(k));
+	ret += value;
+	return ret;
+}
+
+void IdentifierIndex::add(func_t* f, const Function& F)
+{
+	remove(f);
+
+	std::unordered_map<std::string, std::vector<std::size_t>> uses;
+	for (std::size_t i = 0; i < F.tokenCount(); ++i)
+	{
+		auto k = F.tokenKind(i);
+		if (isIndexed(k))
+		{
+			uses[key(k, F.tokenValue(i))].push_back(i);
+		}
+	}
+	if (uses.empty())
+	{
+		return;
+	}
+	auto& keys = _keys[f];
+	for (auto& p : uses)
+	{
+		keys.insert(p.first);
+		_uses[p.first][f] = std::move(p.second);
+	}
+}
+
+void IdentifierIndex::remove(func_t* f)
+{
+	auto it = _keys.find(f);
+	if (it == _keys.end())
+	{
+		return;
+	}
+	for (auto& k : it->second)
+	{
+		erase(k, f);
+	}
+	_keys.erase(it);
+}
+
+void IdentifierIndex::erase(const std::string& key, func_t* f)
+{
+	auto it = _uses.find(key);
+	if (it == _uses.end())
+	{
+		return;
+	}
+	it->second.erase(f);
+	if (it->second.empty())
+	{
+		_uses.erase(it);
+	}
+}
+
+const IdentifierIndex::Uses& IdentifierIndex::find(
+		Token::Kind k,
+		const std::string& value) const
+{
+	static const Uses empty;
+	auto it = _uses.find(key(k, value));
+	return it == _uses.end() ? empty : it->second;
+}
+
+void IdentifierIndex::rename(
+		func_t* f,
+		Token::Kind k,
+		const std::string& oldVal,
+		const std::string& newVal,
+		const std::vector<std::size_t>& renamed)
+{
+	auto oldKey = key(k, oldVal);
+	erase(oldKey, f);
+	auto& keys = _keys[f];
+	keys.erase(oldKey);
+
+	if (!renamed.empty())
+	{
+		auto newKey = key(k, newVal);
+		auto& is = _uses[newKey][f];
+		is.insert(is.end(), renamed.begin(), renamed.end());
+		std::sort(is.begin(), is.end());
+		is.erase(std::unique(is.begin(), is.end()), is.end());
+		keys.insert(newKey);
+	}
+	if (keys.empty())
+	{
+		_keys.erase(f);
+	}
+}
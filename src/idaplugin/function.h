@@ -2,9 +2,13 @@
 #ifndef RETDEC_FUNCTION_H
 #define RETDEC_FUNCTION_H
 
+#include <cstdint>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <set>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "token.h"
@@ -20,15 +24,24 @@ class Function
 	public:
 		Function();
 		Function(func_t* f, const std::vector<Token>& tokens);
+		/// Function showing only the given comment instead of the source
+		/// code - e.g. while the real one is being decompiled.
+		static Function placeholder(func_t* f, const std::string& comment);
 
 		func_t* fnc() const;
 		std::string getName() const;
 		ea_t getStart() const;
 		ea_t getEnd() const;
 		/// Token at YX.
-		const Token* getToken(YX yx) const;
-		/// All the tokens.
-		const std::map<YX, Token>& getTokens() const;
+		std::optional<Token> getToken(YX yx) const;
+		/// All the tokens, ordered by their YXs. They are copied out of the
+		/// function, use the accessors below to only look at them.
+		std::vector<Token> getTokens() const;
+		/// Number of the tokens, and kind and value of the token on the
+		/// given index (into getTokens()).
+		std::size_t tokenCount() const;
+		Token::Kind tokenKind(std::size_t i) const;
+		std::string_view tokenValue(std::size_t i) const;
 
 		/// YX of the first token.
 		YX min_yx() const;
@@ -43,6 +56,9 @@ class Function
 		/// Entire colored line containing the given YX.
 		/// I.e. concatenation of all the tokens with y == yx.y
 		std::string line_yx(YX yx) const;
+		/// Entire colored line y, ready to be displayed.
+		/// All the lines are rendered on the first call and then only looked up.
+		const qstring& coloredLine(std::size_t y) const;
 		/// Address of the given YX.
 		ea_t yx_2_ea(YX yx) const;
 		/// Addresses of all the XYs with y == yx.y
@@ -51,6 +67,38 @@ class Function
 		YX ea_2_yx(ea_t ea) const;
 		/// Is address inside this function?
 		bool ea_inside(ea_t ea) const;
+		/// Is this only a placeholder without the decompiled source code?
+		bool isPlaceholder() const;
+
+		/// Approximate memory used by the function's data [B], including
+		/// its colored lines, even if they were not rendered yet.
+		std::size_t memoryUsage() const;
+		/// Drop all the data except the IDA function, see FunctionCache.
+		void release();
+		/// Was the data dropped by release()?
+		bool isReleased() const;
+		/// Unique for every content of a function object - it changes when
+		/// another function is assigned to it, when its tokens are renamed,
+		/// and when it is released. Places use it to detect that the
+		/// function they point to changed under them.
+		std::uint64_t generation() const;
+
+		/// Indexes (into getTokens()) of the tokens with the given kind and
+		/// value.
+		std::vector<std::size_t> findTokens(
+				Token::Kind k,
+				const std::string& value
+		) const;
+		/// Replace the value of the tokens on the given indexes, which have
+		/// the given kind and old value (the others are skipped). Only the
+		/// lines containing the renamed tokens are laid out again.
+		/// Returns indexes of the renamed tokens.
+		std::vector<std::size_t> renameTokens(
+				const std::vector<std::size_t>& indexes,
+				Token::Kind k,
+				const std::string& oldVal,
+				const std::string& newVal
+		);
 
 		/// Lines with associated addresses.
 		std::vector<std::pair<std::string, ea_t>> toLines() const;
@@ -58,11 +106,96 @@ class Function
 		friend std::ostream& operator<<(std::ostream& os, const Function& f);
 
 	private:
+		/// Token without its value, which is stored in _text.
+		struct TokenData
+		{
+			ea_t ea = BADADDR;
+			std::uint32_t offset = 0;
+			std::uint32_t size = 0;
+			Token::Kind kind = Token::Kind::NEW_LINE;
+		};
+
+	private:
+		/// Value of the token.
+		std::string_view text(const TokenData& t) const;
+		/// Index of the token containing the given YX, see adjust_yx().
+		/// \c npos if there are no tokens.
+		std::size_t tokenIndex(YX yx) const;
+		/// Render colored line (index into _lines) into _coloredLines.
+		void renderLine(std::size_t l) const;
+		/// Append colored token to the line.
+		void appendColored(qstring& line, const TokenData& t) const;
+		void appendColored(std::string& line, const TokenData& t) const;
+
+	private:
+		inline static const std::size_t npos = std::size_t(-1);
+		inline static std::uint64_t _lastGeneration = 0;
+
 		func_t* _fnc = nullptr;
-		std::map<YX, Token> _tokens;
+		/// Tokens and their [starting] YXs, both ordered by the YXs.
+		/// Lookups are binary searches, not tree walks.
+		std::vector<TokenData> _tokens;
+		std::vector<YX> _yxs;
+		/// Values of all the tokens. Equal values are stored only once
+		/// when the function is created, renamed tokens get a new value
+		/// appended, the old one is left unused.
+		std::string _text;
+		/// Index of the first token on each line, with one extra element
+		/// (number of tokens) at the end.
+		std::vector<std::size_t> _lines;
 		/// Multiple YXs can be associated with the same address.
-		/// This stores the first such XY.
-		std::map<ea_t, YX> _ea2yx;
+		/// This stores the first such XY, ordered by addresses.
+		std::vector<std::pair<ea_t, YX>> _ea2yx;
+		/// Lazily rendered colored lines, see coloredLine().
+		/// Lines changed by renameTokens() are rendered again.
+		mutable std::vector<qstring> _coloredLines;
+		bool _placeholder = false;
+		bool _released = false;
+		std::uint64_t _generation = ++_lastGeneration;
+};
+
+/**
+ * Reverse index of global identifiers (functions and global variables) to
+ * the decompiled functions and their tokens referencing them, so that
+ * renaming an identifier touches only the functions using it.
+ */
+class IdentifierIndex
+{
+	public:
+		/// Function -> indexes of its tokens (see Function::getTokens()).
+		using Uses = std::map<func_t*, std::vector<std::size_t>>;
+
+		/// Are identifiers of this kind indexed?
+		static bool isIndexed(Token::Kind k);
+
+		/// Index identifiers of the given function, replacing all its
+		/// previous uses.
+		void add(func_t* f, const Function& F);
+		/// Drop all the uses in the given function.
+		void remove(func_t* f);
+		/// Uses of the given identifier.
+		const Uses& find(Token::Kind k, const std::string& value) const;
+		/// Tokens on the \p renamed indexes of the function were renamed
+		/// from the old value to the new one (see Function::renameTokens()).
+		/// The function's other uses of the old value are dropped, their
+		/// tokens no longer have it.
+		void rename(
+				func_t* f,
+				Token::Kind k,
+				const std::string& oldVal,
+				const std::string& newVal,
+				const std::vector<std::size_t>& renamed
+		);
+
+	private:
+		static std::string key(Token::Kind k, std::string_view value);
+		/// Drop the uses of the identifier in the function.
+		void erase(const std::string& key, func_t* f);
+
+	private:
+		std::unordered_map<std::string, Uses> _uses;
+		/// Keys of the identifiers used by each function, see remove().
+		std::map<func_t*, std::set<std::string>> _keys;
 };
 
 #endif
@@ -0,0 +1,99 @@
+
+#include <algorithm>
+
+#include "config.h"
+#include "names.h"
+
+ea_t NameIndex::find(const std::string& name)
+{
+	if (!_valid)
+	{
+		build();
+	}
+
+	ea_t ret = BADADDR;
+	auto range = _name2ea.equal_range(name);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		ret = std::min(ret, it->second);
+	}
+	return ret;
+}
+
+void NameIndex::update(ea_t ea)
+{
+	if (!_valid)
+	{
+		return;
+	}
+
+	remove(ea);
+	func_t* f = get_func(ea);
+	if (f && f->start_ea == ea)
+	{
+		add(f);
+	}
+}
+
+void NameIndex::remove(ea_t ea)
+{
+	auto fit = _ea2names.find(ea);
+	if (!_valid || fit == _ea2names.end())
+	{
+		return;
+	}
+
+	for (auto& name : fit->second)
+	{
+		auto range = _name2ea.equal_range(name);
+		for (auto it = range.first; it != range.second;)
+		{
+			it = it->second == ea ? _name2ea.erase(it) : std::next(it);
+		}
+	}
+	_ea2names.erase(fit);
+}
+
+void NameIndex::invalidate()
+{
+	_valid = false;
+	_name2ea.clear();
+	_ea2names.clear();
+}
+
+void NameIndex::build()
+{
+	invalidate();
+
+	auto n = get_func_qty();
+	_name2ea.reserve(n);
+	_ea2names.reserve(n);
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		add(getn_func(i));
+	}
+
+	_valid = true;
+}
+
+void NameIndex::add(func_t* f)
+{
+	qstring qName;
+	if (get_func_name(&qName, f->start_ea) <= 0)
+	{
+		return;
+	}
+
+	auto& names = _ea2names[f->start_ea];
+	names.push_back(qName.c_str());
+	auto sanitized = sanitizeFunctionName(names.back());
+	if (sanitized != names.back())
+	{
+		names.push_back(sanitized);
+	}
+
+	for (auto& name : names)
+	{
+		_name2ea.emplace(name, f->start_ea);
+	}
+}
@@ -0,0 +1,47 @@
+
+#ifndef RETDEC_NAMES_H
+#define RETDEC_NAMES_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.h"
+
+/**
+ * Index of function names to their start addresses - both IDA names and
+ * their sanitized forms used in decompilation configs (and therefore in the
+ * decompiled code).
+ *
+ * Names from the decompiled code are looked up on every popup menu,
+ * double-click, or rename, which would otherwise have to scan all the
+ * functions. The index is built by the first lookup, then kept up to date by
+ * IDB events (see idbListener_t).
+ */
+class NameIndex
+{
+	public:
+		/// Start of the function with the given name. If there are more such
+		/// functions, the one with the lowest address is returned.
+		/// Returns \c BADADDR if there is no such function.
+		ea_t find(const std::string& name);
+
+		/// Function starting at the given address was added or renamed.
+		void update(ea_t ea);
+		/// Function starting at the given address is being deleted.
+		void remove(ea_t ea);
+		/// Rebuild the entire index on the next lookup.
+		void invalidate();
+
+	private:
+		void build();
+		void add(func_t* f);
+
+	private:
+		bool _valid = false;
+		std::unordered_multimap<std::string, ea_t> _name2ea;
+		/// Indexed names of each function.
+		std::unordered_map<ea_t, std::vector<std::string>> _ea2names;
+};
+
+#endif
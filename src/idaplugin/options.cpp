@@ -0,0 +1,142 @@
+
+#include <algorithm>
+#include <thread>
+
+#include <retdec/utils/filesystem.h>
+
+#include "options.h"
+#include "utils.h"
+
+Options Options::fromPluginOptions()
+{
+	const char* str = get_plugin_options("retdec");
+	return fromString(str ? str : "");
+}
+
+Options Options::fromString(const std::string& str)
+{
+	Options ret;
+
+	fs::path idaDir(get_user_idadir());
+	ret.cacheDir = (idaDir / "retdec" / "cache").string();
+
+	for (auto& p : parse(str))
+	{
+		auto& key = p.first;
+		auto& val = p.second;
+		try
+		{
+			if (key == "cache_dir")
+			{
+				ret.cacheDir = val;
+			}
+			else if (key == "cache_max_size")
+			{
+				ret.cacheMaxSize = std::stoull(val);
+			}
+			else if (key == "cache_max_age")
+			{
+				ret.cacheMaxAge = std::stoull(val);
+			}
+			else if (key == "function_cache_size")
+			{
+				ret.functionCacheSize = std::stoull(val);
+			}
+			else if (key == "workers")
+			{
+				ret.workers = std::stoul(val);
+			}
+			else if (key == "worker_max_memory")
+			{
+				ret.workerMaxMemory = std::stoull(val);
+			}
+			else if (key == "timeout")
+			{
+				ret.timeout = std::stoull(val);
+			}
+			else if (key == "prefetch_depth")
+			{
+				ret.prefetchDepth = std::stoul(val);
+			}
+			else if (key == "prefetch_budget")
+			{
+				ret.prefetchBudget = std::stoul(val);
+			}
+			else if (key == "profile")
+			{
+				ret.profile = std::stoul(val) != 0;
+			}
+			else if (key == "profile_json")
+			{
+				ret.profileJson = val;
+			}
+			else if (key == "profile_trace")
+			{
+				ret.profileTrace = val;
+			}
+			else if (key == "select")
+			{
+				// Commas separate the options, functions are therefore
+				// separated by semicolons or whitespaces.
+				ret.select = splitString(val, "; \t");
+			}
+			else if (key == "output")
+			{
+				ret.output = val;
+			}
+			else
+			{
+				WARNING_MSG("Unknown plugin option: " << key << "\n");
+			}
+		}
+		catch (const std::logic_error&)
+		{
+			WARNING_MSG("Invalid value of plugin option " << key
+					<< ": " << val << "\n");
+		}
+	}
+
+	return ret;
+}
+
+std::map<std::string, std::string> Options::parse(const std::string& str)
+{
+	std::map<std::string, std::string> ret;
+
+	std::size_t pos = 0;
+	while (pos < str.size())
+	{
+		auto end = str.find(',', pos);
+		if (end == std::string::npos)
+		{
+			end = str.size();
+		}
+
+		auto item = str.substr(pos, end - pos);
+		auto eq = item.find('=');
+		if (item.empty())
+		{
+			// nothing
+		}
+		else if (eq == std::string::npos)
+		{
+			ret[item] = "1";
+		}
+		else
+		{
+			ret[item.substr(0, eq)] = item.substr(eq + 1);
+		}
+
+		pos = end + 1;
+	}
+
+	return ret;
+}
+
+/**
+ * Half of the cores, but at most 4 - each worker may need gigabytes of memory.
+ */
+unsigned Options::defaultWorkers()
+{
+	return std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+}
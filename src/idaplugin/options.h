@@ -0,0 +1,69 @@
+#ifndef RETDEC_OPTIONS_H
+#define RETDEC_OPTIONS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Plugin options.
+ *
+ * Options are passed on IDA command line:
+ *     -Oretdec:<key>=<value>,<key>=<value>,...
+ * Unknown keys are reported and ignored, missing keys keep their default
+ * values.
+ */
+struct Options
+{
+	/// Directory of the decompilation cache shared across IDBs.
+	/// Empty string disables the cache.
+	std::string cacheDir;
+	/// The shared cache is trimmed to this size [MB].
+	std::uint64_t cacheMaxSize = 1024;
+	/// Shared cache entries older than this are removed [days].
+	std::uint64_t cacheMaxAge = 30;
+	/// Memory of the decompiled functions kept in IDA [MB], 0 = unlimited.
+	std::uint64_t functionCacheSize = 512;
+
+	/// Number of decompilation worker processes, 0 = decompile inside IDA.
+	unsigned workers = defaultWorkers();
+	/// Memory limit of each worker process [MB], 0 = half of the system
+	/// memory.
+	std::uint64_t workerMaxMemory = 0;
+
+	/// Time limit of one decompilation in a worker process [s], 0 = no
+	/// limit. Worker process running out of time is killed.
+	std::uint64_t timeout = 0;
+
+	/// Functions up to this many calls away from the displayed function are
+	/// decompiled in the background, 0 = no prefetching.
+	unsigned prefetchDepth = 0;
+	/// Maximum number of functions prefetched for one displayed function.
+	unsigned prefetchBudget = 16;
+
+	/// Print profiles of decompilations and of the whole session.
+	bool profile = false;
+	/// Files the session profile is exported into when the plugin unloads,
+	/// empty = no export. Setting any of them enables profiling.
+	std::string profileJson;
+	std::string profileTrace;
+
+	/// Functions decompiled by the headless selective decompilation
+	/// (plugin arguments 2 and 4) - addresses inside them, or their names.
+	/// Empty = functions tagged by "<retdec_select>" comment.
+	std::vector<std::string> select;
+	/// Output file of the headless decompilations, empty = "<input>.c".
+	std::string output;
+
+	/// Parse options set for the plugin in IDA.
+	static Options fromPluginOptions();
+	/// Parse options from "<key>=<value>,<key>=<value>,..." string.
+	static Options fromString(const std::string& str);
+
+	private:
+		static std::map<std::string, std::string> parse(const std::string& str);
+		static unsigned defaultWorkers();
+};
+
+#endif
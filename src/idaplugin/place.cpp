@@ -33,7 +33,8 @@ void idaapi retdec_place_t::copyfrom(const place_t* from)
 	auto* p = static_cast<const retdec_place_t*>(from);
 
 	lnnum = p->lnnum;
-	_fnc = p->_fnc;
+	_fncStart = p->_fncStart;
+	_generation = p->_generation;
 	_yx = p->_yx;
 }
 
@@ -42,7 +43,8 @@ place_t* idaapi retdec_place_t::makeplace(
 		uval_t y,
 		int lnnum) const
 {
-	auto* p = new retdec_place_t(_fnc, YX(y, 0));
+	auto* p = new retdec_place_t(*this);
+	p->_yx = YX(y, 0);
 	p->lnnum = lnnum;
 	return p;
 }
@@ -56,7 +58,7 @@ int idaapi retdec_place_t::compare2(const place_t* t2, void *ud) const
 {
 	auto* p = static_cast<const retdec_place_t*>(t2);
 
-	if (_fnc == p->_fnc)
+	if (_fncStart == p->_fncStart)
 	{
 		if (yx() < p->yx()) return -1;
 		else if (yx() > p->yx()) return 1;
@@ -64,7 +66,7 @@ int idaapi retdec_place_t::compare2(const place_t* t2, void *ud) const
 	}
 	// I'm not sure if this can happen (i.e. places from different functions
 	// are compared), but better safe than sorry.
-	else if (_fnc->getStart() < p->_fnc->getStart())
+	else if (_fncStart < p->_fncStart)
 	{
 		return -1;
 	}
@@ -86,8 +88,13 @@ void idaapi retdec_place_t::adjust(void* ud)
 
 bool idaapi retdec_place_t::prev(void* ud)
 {
-	auto pyx = _fnc->prev_yx(yx());
-	if (yx() <= _fnc->min_yx() || pyx == yx())
+	auto* fnc = this->fnc();
+	if (fnc == nullptr)
+	{
+		return false;
+	}
+	auto pyx = fnc->prev_yx(yx());
+	if (yx() <= fnc->min_yx() || pyx == yx())
 	{
 		return false;
 	}
@@ -97,8 +104,13 @@ bool idaapi retdec_place_t::prev(void* ud)
 
 bool idaapi retdec_place_t::next(void* ud)
 {
-	auto nyx = _fnc->next_yx(yx());
-	if (yx() >= _fnc->max_yx() || nyx == yx())
+	auto* fnc = this->fnc();
+	if (fnc == nullptr)
+	{
+		return false;
+	}
+	auto nyx = fnc->next_yx(yx());
+	if (yx() >= fnc->max_yx() || nyx == yx())
 	{
 		return false;
 	}
@@ -108,12 +120,14 @@ bool idaapi retdec_place_t::next(void* ud)
 
 bool idaapi retdec_place_t::beginning(void* ud) const
 {
-	return yx() == _fnc->min_yx();
+	auto* fnc = this->fnc();
+	return fnc == nullptr || yx() == fnc->min_yx();
 }
 
 bool idaapi retdec_place_t::ending(void* ud) const
 {
-	return yx() == _fnc->max_yx();
+	auto* fnc = this->fnc();
+	return fnc == nullptr || yx() == fnc->max_yx();
 }
 
 int idaapi retdec_place_t::generate(
@@ -128,29 +142,27 @@ int idaapi retdec_place_t::generate(
 	{
 		return 0;
 	}
-	if (x() != 0)
+	auto* fnc = this->fnc();
+	if (fnc == nullptr || x() != 0)
 	{
 		return 0;
 	}
 
 	*out_deflnnum = 0;
 
-	std::string str = _fnc->line_yx(yx());
-	out->push_back(str.c_str());
+	out->push_back(fnc->coloredLine(y()));
 	return 1;
 }
 
 // All members must be serialized and deserialized.
 // This is apparently used when places are moved around.
-// When I didn't serialize _fnc pointer, I lost the info about it when
-// place was set to lochist_entry_t.
-// However, this is also used when saving/loading IDB, and so if we store and
-// than load function pointer, we are in trouble. Instead we serialize functions
-// as their addresses and use decompiler to get an actual function pointer.
+// This is also used when saving/loading IDB, and so functions are serialized
+// as their addresses. Places resolve them from the functions decompiled in
+// this session or cached in IDB. We do not decompile here.
 void idaapi retdec_place_t::serialize(bytevec_t* out) const
 {
 	place_t__serialize(this, out);
-	out->pack_ea(_fnc->getStart());
+	out->pack_ea(_fncStart);
 	out->pack_ea(y());
 	out->pack_ea(x());
 }
@@ -164,9 +176,17 @@ bool idaapi retdec_place_t::deserialize(
 		return false;
 	}
 	auto fa = unpack_ea(pptr, end);
-	_fnc = RetDec::selectiveDecompilation(fa, false);
+	auto* fnc = RetDec::getRestoredFunction(fa);
+	if (fnc == nullptr)
+	{
+		return false;
+	}
 	auto y = unpack_ea(pptr, end);
 	auto x = unpack_ea(pptr, end);
+	_fncStart = fnc->getStart();
+	// Serialized YX belongs to the function as it was when serialized,
+	// make fnc() check it.
+	_generation = 0;
 	_yx = YX(y, x);
 	return true;
 }
@@ -183,7 +203,8 @@ const char* idaapi retdec_place_t::name() const
 
 ea_t idaapi retdec_place_t::toea() const
 {
-	return _fnc->yx_2_ea(yx());
+	auto* fnc = this->fnc();
+	return fnc ? fnc->yx_2_ea(yx()) : BADADDR;
 }
 
 bool idaapi retdec_place_t::rebase(const segm_move_infos_t&)
@@ -206,7 +227,8 @@ void idaapi retdec_place_t::leave(uint32) const
 int retdec_place_t::ID = -1;
 
 retdec_place_t::retdec_place_t(Function* fnc, YX yx)
-		: _fnc(fnc)
+		: _fncStart(fnc ? fnc->getStart() : BADADDR)
+		, _generation(fnc ? fnc->generation() : 0)
 		, _yx(yx)
 {
 	lnnum = 0;
@@ -261,14 +283,35 @@ std::size_t retdec_place_t::x() const
 	return yx().x;
 }
 
-const Token* retdec_place_t::token() const
+std::optional<Token> retdec_place_t::token() const
 {
-	return fnc()->getToken(yx());
+	auto* fnc = this->fnc();
+	return fnc ? fnc->getToken(yx()) : std::nullopt;
 }
 
 Function* retdec_place_t::fnc() const
 {
-	return _fnc;
+	if (_fncStart == BADADDR)
+	{
+		return nullptr;
+	}
+
+	auto* fnc = RetDec::getPlaceFunction(_fncStart);
+	if (fnc && fnc->generation() != _generation)
+	{
+		// Function was decompiled again, renamed, or released and loaded
+		// again since this place was created. Keep the place inside it.
+		_generation = fnc->generation();
+		if (_yx < fnc->min_yx())
+		{
+			_yx = fnc->min_yx();
+		}
+		else if (_yx > fnc->max_yx())
+		{
+			_yx = fnc->max_yx();
+		}
+	}
+	return fnc;
 }
 
 std::string retdec_place_t::toString() const
@@ -280,7 +323,16 @@ std::string retdec_place_t::toString() const
 
 std::ostream& operator<<(std::ostream& os, const retdec_place_t& p)
 {
-	os << *p.fnc() << p.yx();
+	// Function of the place may no longer exist.
+	if (auto* F = p.fnc())
+	{
+		os << *F;
+	}
+	else
+	{
+		os << "<" << std::hex << p._fncStart << ">";
+	}
+	os << p.yx();
 	return os;
 }
 
@@ -306,15 +358,19 @@ lecvt_code_t idaapi place_converter(
 			return LECVT_ERROR;
 		}
 
-		if (cur->fnc()->ea_inside(idaEa))
+		auto* curFnc = cur->fnc();
+		if (curFnc && curFnc->ea_inside(idaEa))
 		{
-			retdec_place_t p(cur->fnc(), cur->fnc()->ea_2_yx(idaEa));
+			retdec_place_t p(curFnc, curFnc->ea_2_yx(idaEa));
 			dst->set_place(p);
 			// Set both x and y, see renderer_info_t comment in demo.cpp.
 			dst->renderer_info().pos.cy = p.y();
 			dst->renderer_info().pos.cx = p.x();
 		}
-		else if (Function* fnc = RetDec::selectiveDecompilation(idaEa, false))
+		else if (Function* fnc = static_cast<RetDec*>(
+				get_viewer_user_data(view))->selectiveDecompilationAsync(
+						idaEa,
+						false))
 		{
 			retdec_place_t cur(fnc, fnc->ea_2_yx(idaEa));
 			dst->set_place(cur);
@@ -3,6 +3,7 @@
 #define RETDEC_PLACE_H
 
 #include <iostream>
+#include <optional>
 
 #include "function.h"
 #include "retdec.h"
@@ -191,7 +192,8 @@ class retdec_place_t : public place_t
 		YX yx() const;
 		std::size_t y() const;
 		std::size_t x() const;
-		const Token* token() const;
+		std::optional<Token> token() const;
+		/// Function of the place, \c nullptr if it no longer exists.
 		Function* fnc() const;
 
 		std::string toString() const;
@@ -203,8 +205,13 @@ class retdec_place_t : public place_t
 	private:
 		inline static const char* _name = "retdec_place_t";
 
-		Function* _fnc = nullptr;
-		YX _yx;
+		/// Places do not keep pointers to functions, which may be replaced
+		/// under them. They resolve the functions by their start addresses,
+		/// see fnc().
+		ea_t _fncStart = BADADDR;
+		/// Function::generation() the place's YX belongs to.
+		mutable std::uint64_t _generation = 0;
+		mutable YX _yx;
 };
 
 /// Converts from an entry with a given place type, to another entry,
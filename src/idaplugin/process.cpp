@@ -0,0 +1,633 @@
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#include "decompilation.h"
+#include "process.h"
+#include "profiler.h"
+
+namespace {
+
+/**
+ * Kills the worker process if the request is not answered in time.
+ */
+class Watchdog
+{
+	public:
+		Watchdog(WorkerProcess& process, std::uint64_t timeout)
+		{
+			if (timeout == 0)
+			{
+				return;
+			}
+			_thread = std::thread([this, &process, timeout]
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				if (!_cv.wait_for(
+						lock,
+						std::chrono::seconds(timeout),
+						[this] { return _done; }))
+				{
+					_expired = true;
+					process.terminate();
+				}
+			});
+		}
+
+		~Watchdog()
+		{
+			stop();
+		}
+
+		/// Stop watching. Returns \c true if the process was killed.
+		bool stop()
+		{
+			if (_thread.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_done = true;
+				}
+				_cv.notify_one();
+				_thread.join();
+			}
+			return _expired;
+		}
+
+	private:
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		bool _done = false;
+		bool _expired = false;
+		std::thread _thread;
+};
+
+} // anonymous namespace
+
+WorkerProcess::WorkerProcess(
+		const std::string& path,
+		std::uint64_t memoryLimit,
+		std::uint64_t timeout)
+		: _path(path)
+		, _memoryLimit(memoryLimit)
+		, _timeout(timeout)
+{
+
+}
+
+WorkerProcess::~WorkerProcess()
+{
+	stop();
+}
+
+bool WorkerProcess::decompile(
+		const retdec::config::Config& config,
+		std::uint64_t generation,
+		const AddressRanges& ranges,
+		std::string& output,
+		std::string& error)
+{
+	if (generation == 0 || generation != _generation || !isRunning())
+	{
+		Profiler::Phase phase("config.send");
+		_generation = 0;
+		std::string ignored;
+		if (request(
+				protocol::requestConfig + config.generateJsonString(),
+				ignored,
+				error))
+		{
+			return true;
+		}
+		_generation = generation;
+	}
+
+	std::string req(1, protocol::requestDecompile);
+	for (auto& r : ranges)
+	{
+		req += protocol::encodeSize(r.first);
+		req += protocol::encodeSize(r.second);
+	}
+	return request(req, output, error);
+}
+
+std::uint64_t WorkerProcess::peakRss() const
+{
+	return _peakRss;
+}
+
+bool WorkerProcess::request(
+		const std::string& payload,
+		std::string& response,
+		std::string& error)
+{
+	if (!isRunning() && start(error))
+	{
+		return true;
+	}
+
+	// The decompiler's own time limit is not enforced by the library, the
+	// process is killed instead.
+	_peakRss = 0;
+	std::string answer;
+	Watchdog watchdog(*this, _timeout);
+	bool failed = exchange(payload, answer, error);
+	if (watchdog.stop())
+	{
+		// Killed, maybe right after answering. The next request starts
+		// a new process.
+		stop();
+		if (failed)
+		{
+			error = "decompilation timed out after "
+					+ std::to_string(_timeout) + " s";
+			return true;
+		}
+	}
+	if (failed)
+	{
+		return true;
+	}
+
+	const std::size_t header = 1 + protocol::sizeLength;
+	if (answer.size() < header)
+	{
+		stop();
+		error = "invalid response from decompilation worker process";
+		return true;
+	}
+	_peakRss = protocol::decodeSize(&answer[1]);
+
+	if (answer[0] == protocol::responseOk)
+	{
+		response = answer.substr(header);
+		return false;
+	}
+	else
+	{
+		error = answer.substr(header);
+		return true;
+	}
+}
+
+/**
+ * Send the request and receive the answer (status character followed by the
+ * payload). The process is stopped if it fails.
+ */
+bool WorkerProcess::exchange(
+		const std::string& payload,
+		std::string& answer,
+		std::string& error)
+{
+	std::string size = protocol::encodeSize(payload.size());
+	if (write(size.data(), size.size())
+			|| write(payload.data(), payload.size()))
+	{
+		stop();
+		error = "decompilation worker process terminated";
+		return true;
+	}
+
+	char buff[protocol::sizeLength];
+	if (read(buff, sizeof(buff)))
+	{
+		// Crashed, or killed for exceeding the memory limit.
+		stop();
+		error = "decompilation worker process terminated";
+		return true;
+	}
+	std::uint64_t n = protocol::decodeSize(buff);
+	bool invalid = n == 0 || n > protocol::maxPayloadSize;
+	if (!invalid)
+	{
+		answer.assign(n, '\0');
+		invalid = read(&answer[0], n);
+	}
+	if (invalid)
+	{
+		stop();
+		error = "invalid response from decompilation worker process";
+		return true;
+	}
+	return false;
+}
+
+#ifdef _WIN32
+
+bool WorkerProcess::start(std::string& error)
+{
+	SECURITY_ATTRIBUTES sa = {};
+	sa.nLength = sizeof(sa);
+	sa.bInheritHandle = TRUE;
+
+	// Child's ends of the pipes are inheritable, ours are not.
+	HANDLE childIn = nullptr;
+	HANDLE childOut = nullptr;
+	HANDLE in = nullptr;
+	HANDLE out = nullptr;
+	if (!CreatePipe(&childIn, &in, &sa, 0)
+			|| !CreatePipe(&out, &childOut, &sa, 0)
+			|| !SetHandleInformation(in, HANDLE_FLAG_INHERIT, 0)
+			|| !SetHandleInformation(out, HANDLE_FLAG_INHERIT, 0))
+	{
+		for (HANDLE h : {childIn, childOut, in, out})
+		{
+			if (h) CloseHandle(h);
+		}
+		error = "unable to create pipes for decompilation worker process";
+		return true;
+	}
+
+	std::string cmd = "\"" + _path + "\"";
+	if (_memoryLimit)
+	{
+		cmd += " --max-memory " + std::to_string(_memoryLimit);
+	}
+
+	// Worker's standard error goes to ours. If we have none (GUI), it goes
+	// to NUL, the worker redirects its standard output there.
+	HANDLE childErr = nullptr;
+	HANDLE err = GetStdHandle(STD_ERROR_HANDLE);
+	if (err == nullptr
+			|| err == INVALID_HANDLE_VALUE
+			|| !DuplicateHandle(
+					GetCurrentProcess(),
+					err,
+					GetCurrentProcess(),
+					&childErr,
+					0,
+					TRUE,
+					DUPLICATE_SAME_ACCESS))
+	{
+		childErr = CreateFileA(
+				"NUL",
+				GENERIC_WRITE,
+				FILE_SHARE_READ | FILE_SHARE_WRITE,
+				&sa,
+				OPEN_EXISTING,
+				0,
+				nullptr
+		);
+	}
+
+	// Only the handles in the list are inherited. Inheritable ends of the
+	// pipes of workers started by other threads at the same time would be
+	// inherited as well otherwise, and kept open by this worker.
+	std::vector<HANDLE> inherited = {childIn, childOut};
+	if (childErr != INVALID_HANDLE_VALUE)
+	{
+		inherited.push_back(childErr);
+	}
+	SIZE_T attrSize = 0;
+	InitializeProcThreadAttributeList(nullptr, 1, 0, &attrSize);
+	std::vector<char> attrBuff(attrSize);
+	auto* attrs = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(
+			attrBuff.data()
+	);
+	bool attrsOk =
+			InitializeProcThreadAttributeList(attrs, 1, 0, &attrSize) != FALSE;
+
+	STARTUPINFOEXA si = {};
+	si.StartupInfo.cb = sizeof(si);
+	si.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+	si.StartupInfo.hStdInput = childIn;
+	si.StartupInfo.hStdOutput = childOut;
+	si.StartupInfo.hStdError = childErr;
+	si.lpAttributeList = attrs;
+
+	PROCESS_INFORMATION pi = {};
+	BOOL ok = attrsOk
+			&& UpdateProcThreadAttribute(
+					attrs,
+					0,
+					PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+					inherited.data(),
+					inherited.size() * sizeof(HANDLE),
+					nullptr,
+					nullptr)
+			&& CreateProcessA(
+					nullptr,
+					&cmd[0],
+					nullptr,
+					nullptr,
+					TRUE,
+					CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT,
+					nullptr,
+					nullptr,
+					&si.StartupInfo,
+					&pi
+			);
+	if (attrsOk)
+	{
+		DeleteProcThreadAttributeList(attrs);
+	}
+	CloseHandle(childIn);
+	CloseHandle(childOut);
+	if (childErr != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(childErr);
+	}
+	if (!ok)
+	{
+		CloseHandle(in);
+		CloseHandle(out);
+		error = "unable to start decompilation worker process " + _path;
+		return true;
+	}
+	CloseHandle(pi.hThread);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_process = pi.hProcess;
+	}
+	_in = in;
+	_out = out;
+	return false;
+}
+
+void WorkerProcess::stop()
+{
+	if (_in)
+	{
+		// Worker exits when its input is closed.
+		CloseHandle(_in);
+		_in = nullptr;
+	}
+	if (_out)
+	{
+		CloseHandle(_out);
+		_out = nullptr;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_process)
+	{
+		if (WaitForSingleObject(_process, 1000) != WAIT_OBJECT_0)
+		{
+			TerminateProcess(_process, 1);
+		}
+		CloseHandle(_process);
+		_process = nullptr;
+	}
+}
+
+void WorkerProcess::terminate()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_process)
+	{
+		TerminateProcess(_process, 1);
+	}
+}
+
+bool WorkerProcess::isRunning() const
+{
+	return _process != nullptr;
+}
+
+bool WorkerProcess::write(const char* data, std::size_t size)
+{
+	while (size)
+	{
+		DWORD n = 0;
+		DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+		if (!WriteFile(_in, data, chunk, &n, nullptr))
+		{
+			return true;
+		}
+		data += n;
+		size -= n;
+	}
+	return false;
+}
+
+bool WorkerProcess::read(char* data, std::size_t size)
+{
+	while (size)
+	{
+		DWORD n = 0;
+		DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+		if (!ReadFile(_out, data, chunk, &n, nullptr) || n == 0)
+		{
+			return true;
+		}
+		data += n;
+		size -= n;
+	}
+	return false;
+}
+
+#else
+
+/**
+ * Pipe whose ends are not inherited by spawned processes. Other workers
+ * would keep our ends open after we close them.
+ * Returns \c true if something went wrong.
+ */
+static bool createPipe(int fds[2])
+{
+#ifdef __APPLE__
+	// No pipe2() on macOS.
+	if (pipe(fds) != 0)
+	{
+		return true;
+	}
+	for (int i : {0, 1})
+	{
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	// Writing into a pipe closed by a dead worker fails by EPIPE instead
+	// of raising SIGPIPE.
+	fcntl(fds[1], F_SETNOSIGPIPE, 1);
+	return false;
+#else
+	// The flag is set atomically with the creation, a worker spawned by
+	// another thread in between would inherit the ends otherwise.
+	return pipe2(fds, O_CLOEXEC) != 0;
+#endif
+}
+
+bool WorkerProcess::start(std::string& error)
+{
+	int inPipe[2] = {-1, -1};
+	int outPipe[2] = {-1, -1};
+	if (createPipe(inPipe) || createPipe(outPipe))
+	{
+		for (int fd : {inPipe[0], inPipe[1], outPipe[0], outPipe[1]})
+		{
+			if (fd >= 0) close(fd);
+		}
+		error = "unable to create pipes for decompilation worker process";
+		return true;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, inPipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+	for (int fd : {inPipe[0], inPipe[1], outPipe[0], outPipe[1]})
+	{
+		posix_spawn_file_actions_addclose(&actions, fd);
+	}
+
+	std::string limit = std::to_string(_memoryLimit);
+	std::vector<char*> argv = {const_cast<char*>(_path.c_str())};
+	if (_memoryLimit)
+	{
+		argv.push_back(const_cast<char*>("--max-memory"));
+		argv.push_back(const_cast<char*>(limit.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	pid_t pid = -1;
+	int rc = posix_spawn(
+			&pid,
+			_path.c_str(),
+			&actions,
+			nullptr,
+			argv.data(),
+			environ
+	);
+	posix_spawn_file_actions_destroy(&actions);
+	close(inPipe[0]);
+	close(outPipe[1]);
+	if (rc != 0)
+	{
+		close(inPipe[1]);
+		close(outPipe[0]);
+		error = "unable to start decompilation worker process " + _path;
+		return true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pid = pid;
+	}
+	_in = inPipe[1];
+	_out = outPipe[0];
+	return false;
+}
+
+void WorkerProcess::stop()
+{
+	if (_in >= 0)
+	{
+		// Worker exits when its input is closed.
+		close(_in);
+		_in = -1;
+	}
+	if (_out >= 0)
+	{
+		close(_out);
+		_out = -1;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_pid > 0)
+	{
+		// Worker in the middle of decompilation would not notice the closed
+		// input in a reasonable time.
+		if (waitpid(_pid, nullptr, WNOHANG) == 0)
+		{
+			kill(_pid, SIGKILL);
+			waitpid(_pid, nullptr, 0);
+		}
+		_pid = -1;
+	}
+}
+
+void WorkerProcess::terminate()
+{
+	// Process is reaped only in stop(), therefore the ID can not be reused
+	// by another process while we hold the lock.
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_pid > 0)
+	{
+		kill(_pid, SIGKILL);
+	}
+}
+
+bool WorkerProcess::isRunning() const
+{
+	return _pid > 0;
+}
+
+bool WorkerProcess::write(const char* data, std::size_t size)
+{
+#ifndef __APPLE__
+	// Writing to a dead worker must not kill the whole IDA by SIGPIPE.
+	// This also runs on the UI thread, so the signal is blocked only during
+	// the write, and the one raised by it is consumed before the caller's
+	// mask is restored. A SIGPIPE pending from before is left alone.
+	sigset_t sigpipe;
+	sigset_t pending;
+	sigset_t oldMask;
+	sigemptyset(&sigpipe);
+	sigaddset(&sigpipe, SIGPIPE);
+	sigpending(&pending);
+	bool wasPending = sigismember(&pending, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe, &oldMask);
+#endif
+
+	bool failed = false;
+	while (size)
+	{
+		ssize_t n = ::write(_in, data, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			failed = true;
+			break;
+		}
+		data += n;
+		size -= n;
+	}
+
+#ifndef __APPLE__
+	if (failed && errno == EPIPE && !wasPending)
+	{
+		timespec zero = {0, 0};
+		while (sigtimedwait(&sigpipe, nullptr, &zero) < 0 && errno == EINTR)
+		{
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+#endif
+	return failed;
+}
+
+bool WorkerProcess::read(char* data, std::size_t size)
+{
+	while (size)
+	{
+		ssize_t n = ::read(_out, data, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return true;
+		}
+		data += n;
+		size -= n;
+	}
+	return false;
+}
+
+#endif
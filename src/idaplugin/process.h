@@ -0,0 +1,115 @@
+
+#ifndef RETDEC_PROCESS_H
+#define RETDEC_PROCESS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+#include <retdec/config/config.h>
+
+#include "decompilation.h"
+
+/**
+ * Decompilation worker process (see src/worker) talking to the plugin over
+ * its standard input and output.
+ *
+ * The process is started by the first request and then kept running, so that
+ * it does not have to be started for every decompilation. If it crashes (or
+ * is killed for exceeding its memory or time limit), the request fails and
+ * the next one starts a new process. The process also keeps the decompilation config,
+ * so that only the selected function is sent for most decompilations.
+ *
+ * Does not use IDA API. One object must not be used by multiple threads at
+ * the same time, except for terminate().
+ */
+class WorkerProcess
+{
+	public:
+		/// @param path        Worker executable.
+		/// @param memoryLimit Memory limit of the process [B], 0 = no limit.
+		/// @param timeout     Time limit of one request [s], 0 = no limit.
+		///                    The process is killed when it runs out of
+		///                    time.
+		WorkerProcess(
+				const std::string& path,
+				std::uint64_t memoryLimit,
+				std::uint64_t timeout = 0
+		);
+		~WorkerProcess();
+
+		WorkerProcess(const WorkerProcess&) = delete;
+		WorkerProcess& operator=(const WorkerProcess&) = delete;
+
+		/// Decompile the given address ranges.
+		/// The config is sent to the process only if the process does not
+		/// already keep the config of the same generation.
+		/// @param config     Decompilation config.
+		/// @param generation Generation of the config, 0 if unknown.
+		/// @param ranges     Decompiled address ranges, empty = the whole
+		///                   input.
+		/// @param output     Decompilation output.
+		/// @param error      Set to the failure reason if something went
+		///                   wrong.
+		/// @return \c true if something went wrong.
+		bool decompile(
+				const retdec::config::Config& config,
+				std::uint64_t generation,
+				const AddressRanges& ranges,
+				std::string& output,
+				std::string& error
+		);
+
+		/// Kill the process, the running request (if any) fails.
+		/// Can be called from any thread.
+		void terminate();
+
+		/// Peak resident set size of the process reported in the answer to
+		/// the last request [B], 0 if it was not answered.
+		std::uint64_t peakRss() const;
+
+	private:
+		bool request(
+				const std::string& payload,
+				std::string& response,
+				std::string& error
+		);
+		bool exchange(
+				const std::string& payload,
+				std::string& answer,
+				std::string& error
+		);
+		bool start(std::string& error);
+		void stop();
+		bool isRunning() const;
+		bool write(const char* data, std::size_t size);
+		bool read(char* data, std::size_t size);
+
+	private:
+		std::string _path;
+		std::uint64_t _memoryLimit = 0;
+		std::uint64_t _timeout = 0;
+		/// Generation of the config kept by the process, 0 if none.
+		std::uint64_t _generation = 0;
+		std::uint64_t _peakRss = 0;
+		/// Guards the process handle (ID) between terminate() and stop().
+		std::mutex _mutex;
+
+#ifdef _WIN32
+		// Windows HANDLEs, <windows.h> does not go well with IDA SDK headers.
+		void* _process = nullptr;
+		void* _in = nullptr;
+		void* _out = nullptr;
+#else
+		pid_t _pid = -1;
+		int _in = -1;
+		int _out = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,482 @@
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <ctime>
+#include <sys/resource.h>
+#endif
+
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+
+#include "profiler.h"
+
+namespace {
+
+/// Decompilation the phases measured on the thread belong to.
+thread_local std::string currentDecompilation;
+/// Number of the phases running on the thread.
+thread_local unsigned currentDepth = 0;
+
+std::uint64_t microseconds(std::chrono::steady_clock::duration d)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+/**
+ * One line of a breakdown - times in ms, memory in MB.
+ */
+void printLine(
+		std::ostream& out,
+		const std::string& phase,
+		unsigned depth,
+		double wall,
+		double cpu,
+		double rss,
+		const std::string& extra = std::string())
+{
+	out << "    " << std::string(2 * depth, ' ')
+			<< std::left << std::setw(32 - 2 * depth) << phase << std::right
+			<< std::setw(12) << wall
+			<< std::setw(12) << cpu
+			<< std::setw(12) << rss
+			<< extra << "\n";
+}
+
+} // anonymous namespace
+
+//
+//==============================================================================
+// Profiler::Aggregate
+//==============================================================================
+//
+
+std::uint64_t Profiler::Aggregate::percentile(unsigned p) const
+{
+	if (recent.empty())
+	{
+		return 0;
+	}
+	// Nearest rank.
+	auto sorted = recent;
+	std::size_t rank = (sorted.size() * std::min(p, 100u) + 99) / 100;
+	auto n = rank ? rank - 1 : 0;
+	std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+	return sorted[n];
+}
+
+//
+//==============================================================================
+// Profiler::Phase
+//==============================================================================
+//
+
+Profiler::Phase::Phase(const char* name)
+{
+	if (!Profiler::enabled())
+	{
+		return;
+	}
+	_name = name;
+	++currentDepth;
+	_cpu = threadCpuTime();
+	_start = std::chrono::steady_clock::now();
+}
+
+Profiler::Phase::~Phase()
+{
+	if (_name == nullptr)
+	{
+		return;
+	}
+	auto end = std::chrono::steady_clock::now();
+	--currentDepth;
+
+	Sample s;
+	s.decompilation = currentDecompilation;
+	s.phase = _name;
+	s.depth = currentDepth;
+	s.thread = threadId();
+	s.start = microseconds(_start - Profiler::_start);
+	s.wall = microseconds(end - _start);
+	s.cpu = threadCpuTime() - _cpu;
+	s.peakRss = _ownRss ? peakRss() : _peakRss;
+	record(std::move(s));
+}
+
+void Profiler::Phase::setPeakRss(std::uint64_t rss)
+{
+	_ownRss = false;
+	_peakRss = rss;
+}
+
+//
+//==============================================================================
+// Profiler::Decompilation
+//==============================================================================
+//
+
+Profiler::Decompilation::Decompilation(const std::string& name)
+		: _previous(currentDecompilation)
+{
+	currentDecompilation = name;
+}
+
+Profiler::Decompilation::~Decompilation()
+{
+	currentDecompilation = _previous;
+}
+
+//
+//==============================================================================
+// Profiler
+//==============================================================================
+//
+
+void Profiler::setEnabled(bool enabled)
+{
+	_enabled = enabled;
+}
+
+bool Profiler::enabled()
+{
+	return _enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::record(Sample&& s)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto& a = _aggregates[s.phase];
+	++a.count;
+	a.wall += s.wall;
+	a.maxWall = std::max(a.maxWall, s.wall);
+	a.cpu += s.cpu;
+	a.peakRss = std::max(a.peakRss, s.peakRss);
+	if (a.recent.size() < _maxRecent)
+	{
+		a.recent.push_back(s.wall);
+	}
+	else
+	{
+		a.recent[a.nextRecent] = s.wall;
+		a.nextRecent = (a.nextRecent + 1) % _maxRecent;
+	}
+
+	if (_samples.size() < _maxSamples)
+	{
+		_samples.push_back(s);
+	}
+	else
+	{
+		++_droppedSamples;
+	}
+
+	if (!s.decompilation.empty())
+	{
+		// Decompilations which are never reported (e.g. cancelled ones).
+		if (_unreported.size() >= _maxUnreported
+				&& _unreported.count(s.decompilation) == 0)
+		{
+			_unreported.erase(_unreported.begin());
+		}
+		_unreported[s.decompilation].push_back(std::move(s));
+	}
+}
+
+std::string Profiler::report(const std::string& decompilation)
+{
+	std::vector<Sample> samples;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _unreported.find(decompilation);
+		if (it == _unreported.end())
+		{
+			return std::string();
+		}
+		samples = std::move(it->second);
+		_unreported.erase(it);
+	}
+
+	// Phases end before the phases they are nested in, order them by start
+	// to get the outer phases first. Repeated phases (e.g. one per function)
+	// are merged into the first one.
+	std::stable_sort(samples.begin(), samples.end(), [](auto& a, auto& b)
+	{
+		return a.start < b.start;
+	});
+	std::vector<std::pair<Sample, Aggregate>> phases;
+	std::uint64_t wall = 0;
+	std::uint64_t cpu = 0;
+	std::uint64_t rss = 0;
+	for (auto& s : samples)
+	{
+		auto it = std::find_if(phases.begin(), phases.end(), [&s](auto& p)
+		{
+			return p.first.phase == s.phase && p.first.depth == s.depth;
+		});
+		if (it == phases.end())
+		{
+			it = phases.emplace(phases.end(), s, Aggregate());
+		}
+		auto& a = it->second;
+		++a.count;
+		a.wall += s.wall;
+		a.cpu += s.cpu;
+		a.peakRss = std::max(a.peakRss, s.peakRss);
+
+		if (s.depth == 0)
+		{
+			wall += s.wall;
+			cpu += s.cpu;
+		}
+		rss = std::max(rss, s.peakRss);
+	}
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Profile of " << decompilation << ":\n    "
+			<< std::left << std::setw(32) << "phase" << std::right
+			<< std::setw(12) << "wall [ms]"
+			<< std::setw(12) << "CPU [ms]"
+			<< std::setw(12) << "RSS [MB]"
+			<< std::setw(8) << "count" << "\n";
+	for (auto& p : phases)
+	{
+		auto& a = p.second;
+		std::stringstream count;
+		count << std::setw(8) << a.count;
+		printLine(
+				ss,
+				p.first.phase,
+				p.first.depth,
+				a.wall / 1000.0,
+				a.cpu / 1000.0,
+				a.peakRss / (1024.0 * 1024.0),
+				count.str()
+		);
+	}
+	printLine(
+			ss,
+			"total",
+			0,
+			wall / 1000.0,
+			cpu / 1000.0,
+			rss / (1024.0 * 1024.0)
+	);
+	return ss.str();
+}
+
+std::string Profiler::summary()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_aggregates.empty())
+	{
+		return std::string();
+	}
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "Decompilation profile of the session:\n    "
+			<< std::left << std::setw(32) << "phase" << std::right
+			<< std::setw(12) << "wall [ms]"
+			<< std::setw(12) << "CPU [ms]"
+			<< std::setw(12) << "RSS [MB]"
+			<< std::setw(8) << "count"
+			<< std::setw(12) << "max [ms]" << "\n";
+	for (auto& p : _aggregates)
+	{
+		auto& a = p.second;
+		std::stringstream extra;
+		extra << std::fixed << std::setprecision(1)
+				<< std::setw(8) << a.count
+				<< std::setw(12) << a.maxWall / 1000.0;
+		printLine(
+				ss,
+				p.first,
+				0,
+				a.wall / 1000.0,
+				a.cpu / 1000.0,
+				a.peakRss / (1024.0 * 1024.0),
+				extra.str()
+		);
+	}
+	return ss.str();
+}
+
+std::map<std::string, Profiler::Aggregate> Profiler::aggregates()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _aggregates;
+}
+
+bool Profiler::writeJson(const std::string& path)
+{
+	std::ofstream ofs(path, std::ios::binary);
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	writer.StartObject();
+
+	writer.Key("phases");
+	writer.StartObject();
+	for (auto& p : _aggregates)
+	{
+		writer.Key(p.first.c_str());
+		writer.StartObject();
+		writer.Key("count");
+		writer.Uint64(p.second.count);
+		writer.Key("wallUs");
+		writer.Uint64(p.second.wall);
+		writer.Key("maxWallUs");
+		writer.Uint64(p.second.maxWall);
+		writer.Key("cpuUs");
+		writer.Uint64(p.second.cpu);
+		writer.Key("peakRss");
+		writer.Uint64(p.second.peakRss);
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	writer.Key("samples");
+	writer.StartArray();
+	for (auto& s : _samples)
+	{
+		writer.StartObject();
+		writer.Key("decompilation");
+		writer.String(s.decompilation.c_str());
+		writer.Key("phase");
+		writer.String(s.phase.c_str());
+		writer.Key("depth");
+		writer.Uint(s.depth);
+		writer.Key("thread");
+		writer.Uint(s.thread);
+		writer.Key("startUs");
+		writer.Uint64(s.start);
+		writer.Key("wallUs");
+		writer.Uint64(s.wall);
+		writer.Key("cpuUs");
+		writer.Uint64(s.cpu);
+		writer.Key("peakRss");
+		writer.Uint64(s.peakRss);
+		writer.EndObject();
+	}
+	writer.EndArray();
+
+	writer.Key("droppedSamples");
+	writer.Uint64(_droppedSamples);
+
+	writer.EndObject();
+	ofs.flush();
+	return !ofs;
+}
+
+bool Profiler::writeTrace(const std::string& path)
+{
+	std::ofstream ofs(path, std::ios::binary);
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+	for (auto& s : _samples)
+	{
+		// Complete event, nesting is derived from the times.
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(s.phase.c_str());
+		writer.Key("cat");
+		writer.String("retdec");
+		writer.Key("ph");
+		writer.String("X");
+		writer.Key("ts");
+		writer.Uint64(s.start);
+		writer.Key("dur");
+		writer.Uint64(s.wall);
+		writer.Key("pid");
+		writer.Uint(1);
+		writer.Key("tid");
+		writer.Uint(s.thread);
+		writer.Key("args");
+		writer.StartObject();
+		writer.Key("decompilation");
+		writer.String(s.decompilation.c_str());
+		writer.Key("cpuUs");
+		writer.Uint64(s.cpu);
+		writer.Key("peakRss");
+		writer.Uint64(s.peakRss);
+		writer.EndObject();
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+	ofs.flush();
+	return !ofs;
+}
+
+std::uint32_t Profiler::threadId()
+{
+	// Small numbers instead of system IDs make the traces easier to read.
+	thread_local std::uint32_t id = ++_lastThread;
+	return id;
+}
+
+std::uint64_t Profiler::threadCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+	auto time = [](const FILETIME& ft)
+	{
+		return (std::uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+	};
+	// 100 ns units.
+	return (time(kernel) + time(user)) / 10;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+	{
+		return 0;
+	}
+	return std::uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+std::uint64_t Profiler::peakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		return 0;
+	}
+	return pmc.PeakWorkingSetSize;
+#else
+	rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+	{
+		return 0;
+	}
+#ifdef __APPLE__
+	// Bytes on macOS.
+	return ru.ru_maxrss;
+#else
+	// Kilobytes on Linux.
+	return std::uint64_t(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
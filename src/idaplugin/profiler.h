@@ -0,0 +1,159 @@
+#ifndef RETDEC_PROFILER_H
+#define RETDEC_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Nothing in here may use IDA API - phases are measured on the worker threads
+// too.
+
+/**
+ * Profiler of decompilation phases.
+ *
+ * A phase (config generation, decompiler run, output parsing, ...) is
+ * measured by a Profiler::Phase object living for its duration. Each phase
+ * records wall time, CPU time of its thread, and peak resident set size of
+ * the process when it ends (of the worker process for phases running in it,
+ * see Phase::setPeakRss()). Phases may nest, and belong to the decompilation
+ * set on their thread by Profiler::Decompilation - one decompilation may
+ * span the UI thread and a worker thread.
+ *
+ * Breakdowns of the individual decompilations are reported by report(), the
+ * whole session is aggregated per phase and can be exported into a JSON file
+ * or a Chrome trace file (chrome://tracing, https://ui.perfetto.dev).
+ *
+ * Profiling is disabled by default, phases then cost a single atomic load.
+ */
+class Profiler
+{
+	public:
+		struct Sample
+		{
+			std::string decompilation;
+			std::string phase;
+			/// Nesting depth of the phase on its thread.
+			unsigned depth = 0;
+			std::uint32_t thread = 0;
+			/// Since the start of the session [us].
+			std::uint64_t start = 0;
+			/// Wall time [us].
+			std::uint64_t wall = 0;
+			/// CPU time of the thread [us].
+			std::uint64_t cpu = 0;
+			/// Peak resident set size of the process at the end [B],
+			/// 0 if unknown.
+			std::uint64_t peakRss = 0;
+		};
+
+		/// Phase aggregated over the whole session.
+		struct Aggregate
+		{
+			std::uint64_t count = 0;
+			std::uint64_t wall = 0;
+			std::uint64_t maxWall = 0;
+			std::uint64_t cpu = 0;
+			std::uint64_t peakRss = 0;
+			/// Wall times of the most recent phases, for percentiles.
+			std::vector<std::uint64_t> recent;
+			std::size_t nextRecent = 0;
+
+			/// Percentile (0 - 100) of the recent wall times.
+			std::uint64_t percentile(unsigned p) const;
+		};
+
+		/// Measures a phase from its construction to its destruction.
+		class Phase
+		{
+			public:
+				/// \param name Must outlive the object, use string literals.
+				Phase(const char* name);
+				~Phase();
+
+				Phase(const Phase&) = delete;
+				Phase& operator=(const Phase&) = delete;
+
+				/// Record \p rss (0 = unknown) instead of the peak resident
+				/// set size of this process. For phases running in another
+				/// process, e.g. WorkerProcess::peakRss().
+				void setPeakRss(std::uint64_t rss);
+
+			private:
+				/// \c nullptr if profiling was disabled at the start.
+				const char* _name = nullptr;
+				std::chrono::steady_clock::time_point _start;
+				std::uint64_t _cpu = 0;
+				bool _ownRss = true;
+				std::uint64_t _peakRss = 0;
+		};
+
+		/// Phases measured on the thread belong to the given decompilation
+		/// until the object is destroyed.
+		class Decompilation
+		{
+			public:
+				Decompilation(const std::string& name);
+				~Decompilation();
+
+				Decompilation(const Decompilation&) = delete;
+				Decompilation& operator=(const Decompilation&) = delete;
+
+			private:
+				std::string _previous;
+		};
+
+	public:
+		static void setEnabled(bool enabled);
+		static bool enabled();
+
+		/// Breakdown of the phases of the decompilation, empty if nothing
+		/// was measured. The phases are forgotten afterwards, except for the
+		/// session aggregates and exports.
+		static std::string report(const std::string& decompilation);
+		/// Phases aggregated over the whole session, empty if nothing was
+		/// measured.
+		static std::string summary();
+		/// Phases aggregated over the whole session, indexed by their names.
+		static std::map<std::string, Aggregate> aggregates();
+
+		/// Export the session aggregates and phases into a JSON file.
+		/// Returns \c true if something went wrong.
+		static bool writeJson(const std::string& path);
+		/// Export the session phases into a Chrome trace file.
+		/// Returns \c true if something went wrong.
+		static bool writeTrace(const std::string& path);
+
+		/// Peak resident set size of the calling process [B].
+		static std::uint64_t peakRss();
+
+	private:
+		static void record(Sample&& s);
+		static std::uint32_t threadId();
+		/// CPU time of the calling thread [us].
+		static std::uint64_t threadCpuTime();
+
+	private:
+		inline static std::atomic<bool> _enabled = false;
+		inline static const std::chrono::steady_clock::time_point _start =
+				std::chrono::steady_clock::now();
+		inline static std::atomic<std::uint32_t> _lastThread = 0;
+
+		inline static std::mutex _mutex;
+		inline static std::map<std::string, Aggregate> _aggregates;
+		/// Phases of decompilations that were not reported yet.
+		inline static std::map<std::string, std::vector<Sample>> _unreported;
+		/// All the phases of the session, for exports.
+		inline static std::vector<Sample> _samples;
+		inline static std::uint64_t _droppedSamples = 0;
+
+		/// Keep memory in bounds in long sessions.
+		inline static const std::size_t _maxUnreported = 1024;
+		inline static const std::size_t _maxSamples = 100000;
+		inline static const std::size_t _maxRecent = 1024;
+};
+
+#endif
@@ -1,11 +1,21 @@
 
-#include <retdec/retdec/retdec.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 #include <retdec/utils/binary_path.h>
 
+#include "cache.h"
 #include "function.h"
 #include "config.h"
 #include "place.h"
+#include "profiler.h"
 #include "retdec.h"
+#include "shards.h"
 #include "ui.h"
 
 plugmod_t* idaapi init(void)
@@ -28,7 +38,29 @@ plugin_t PLUGIN =
 };
 
 std::map<func_t*, Function> RetDec::fnc2fnc;
+FunctionCache RetDec::functionCache;
+IdentifierIndex RetDec::identifiers;
 retdec::config::Config RetDec::config;
+IncrementalConfig RetDec::incrementalConfig;
+Options RetDec::options;
+DiskCache RetDec::diskCache;
+DecompilationStats RetDec::decompilationStats;
+std::string RetDec::workerProcess;
+NameIndex RetDec::functionNames;
+
+/// Plugin instance used by the IDC functions.
+static RetDec* idcPlugin = nullptr;
+static error_t idaapi idcDecompile(idc_value_t* argv, idc_value_t* res);
+static const char idcDecompileArgs[] = { VT_STR, VT_STR, 0 };
+static const ext_idcfunc_t idcDecompile_desc =
+{
+	"RetDecDecompile",
+	idcDecompile,
+	idcDecompileArgs,
+	nullptr,
+	0,
+	0
+};
 
 RetDec::RetDec()
 {
@@ -46,6 +78,19 @@ RetDec::RetDec()
 		return;
 	}
 
+	options = Options::fromPluginOptions();
+	diskCache.open(
+			options.cacheDir,
+			options.cacheMaxSize * 1024 * 1024,
+			options.cacheMaxAge * 24 * 60 * 60
+	);
+	functionCache.setBudget(options.functionCacheSize * 1024 * 1024);
+	Profiler::setEnabled(options.profile
+			|| !options.profileJson.empty()
+			|| !options.profileTrace.empty()
+	);
+	startWorker();
+
 	if (!register_action(fullDecompilation_ah_desc)
 			|| !attach_action_to_menu(
 					"File/Produce file/Create DIF file",
@@ -54,6 +99,15 @@ RetDec::RetDec()
 	{
 		ERROR_MSG("Failed to register: " << fullDecompilation_ah_t::actionName);
 	}
+	register_action(batchDecompilation_ah_desc);
+	if (!register_action(showStatistics_ah_desc)
+			|| !attach_action_to_menu(
+					"View/Open subviews/",
+					showStatistics_ah_t::actionName,
+					SETMENU_APP))
+	{
+		ERROR_MSG("Failed to register: " << showStatistics_ah_t::actionName);
+	}
 	register_action(jump2asm_ah_desc);
 	register_action(copy2asm_ah_desc);
 	register_action(funcComment_ah_desc);
@@ -64,116 +118,955 @@ RetDec::RetDec()
 
 	retdec_place_t::registerPlace(PLUGIN);
 
+	idcPlugin = this;
+	add_idc_func(idcDecompile_desc);
+
 	hook_event_listener(HT_UI, this);
+	hook_event_listener(HT_IDB, &idbListener);
+
+	INFO_MSG(pluginName << " version " << pluginVersion << " loaded OK\n");
+}
+
+/**
+ * Print profile of the decompilation into the output window.
+ */
+void printProfile(const std::string& decompilation)
+{
+	if (!Profiler::enabled())
+	{
+		return;
+	}
+	// Always consume the phases, the profiler may be enabled only for the
+	// exports or the statistics viewer.
+	auto profile = Profiler::report(decompilation);
+	if (RetDec::options.profile && !profile.empty())
+	{
+		INFO_MSG(profile);
+	}
+}
+
+/**
+ * Phases measured during the lifetime of the object belong to the given
+ * decompilation, its profile is printed at the end.
+ */
+class ProfiledDecompilation : public Profiler::Decompilation
+{
+	public:
+		ProfiledDecompilation(const std::string& name)
+				: Profiler::Decompilation(name)
+				, _name(name)
+		{
+
+		}
+		~ProfiledDecompilation()
+		{
+			printProfile(_name);
+		}
+
+	private:
+		std::string _name;
+};
+
+/**
+ * Check that functions of the input can be selectively decompiled, warn the
+ * user if they can not.
+ * Returns \c true if they can not.
+ */
+bool checkRelocatable()
+{
+	if (isRelocatable() && inf_get_min_ea() != 0)
+	{
+		WARNING_GUI("RetDec plugin can selectively decompile only "
+				"relocatable objects loaded at 0x0.\n"
+				"Rebase the program to 0x0 or use full decompilation."
+		);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Get function to selectively decompile.
+ * Returns \c nullptr if the function can not be selectively decompiled.
+ */
+func_t* getSelectedFunction(ea_t ea)
+{
+	if (checkRelocatable())
+	{
+		return nullptr;
+	}
+
+	func_t* f = get_func(ea);
+	if (f == nullptr)
+	{
+		WARNING_GUI("Function must be selected by the cursor.\n");
+		return nullptr;
+	}
+
+	return f;
+}
+
+/**
+ * Get functions given by addresses inside them, or by their names. Addresses
+ * are parsed by C rules, e.g. 0x1000 or 4096. Duplicates are skipped.
+ * Returns \c true if some of the functions do not exist.
+ */
+bool getFunctions(
+		const std::vector<std::string>& eas,
+		std::vector<func_t*>& fncs)
+{
+	bool failed = false;
+	std::set<func_t*> seen;
+	for (auto& s : eas)
+	{
+		ea_t ea = BADADDR;
+		try
+		{
+			std::size_t n = 0;
+			auto val = std::stoull(s, &n, 0);
+			if (n == s.size())
+			{
+				ea = val;
+			}
+		}
+		catch (const std::logic_error&)
+		{
+			// Not a number.
+		}
+		if (ea == BADADDR)
+		{
+			ea = get_name_ea(BADADDR, s.c_str());
+		}
+
+		func_t* f = ea == BADADDR ? nullptr : get_func(ea);
+		if (f == nullptr)
+		{
+			WARNING_MSG("Function @ " << s << " does not exist.\n");
+			failed = true;
+		}
+		else if (seen.insert(f).second)
+		{
+			fncs.push_back(f);
+		}
+	}
+	return failed;
+}
+
+/**
+ * Get functions tagged by "<retdec_select>" comment - the old way of telling
+ * the plugin what to decompile, kept for the existing scripts. It scans
+ * comments of all the functions, use the "select" plugin option or the
+ * RetDecDecompile() IDC function instead.
+ */
+std::vector<func_t*> getTaggedFunctions()
+{
+	std::vector<func_t*> fncs;
+	for (unsigned i = 0; i < get_func_qty(); ++i)
+	{
+		qstring qCmt;
+		func_t *fnc = getn_func(i);
+		if (get_func_cmt(&qCmt, fnc, false) > 0
+				&& std::string(qCmt.c_str()).find("<retdec_select>")
+						!= std::string::npos)
+		{
+			fncs.push_back(fnc);
+		}
+	}
+	return fncs;
+}
+
+/**
+ * Get functions to decompile by the headless selective decompilation.
+ */
+std::vector<func_t*> getHeadlessFunctions()
+{
+	if (RetDec::options.select.empty())
+	{
+		return getTaggedFunctions();
+	}
+
+	std::vector<func_t*> fncs;
+	getFunctions(RetDec::options.select, fncs);
+	return fncs;
+}
+
+/**
+ * IDC function RetDecDecompile(functions, out) - decompile the functions
+ * (addresses inside them or their names, separated by whitespaces, commas, or
+ * semicolons) in a single decompiler run and write the decompiled code into
+ * the out file, the same way as the regression tests do (see
+ * RetDec::regressionDecompilation()). If out is empty, the functions are
+ * decompiled in the background. Returns the number of decompiled functions,
+ * or -1 if some of the functions do not exist. Unlike the "<retdec_select>"
+ * tags, it does not modify the IDB and may be called any number of times in
+ * one IDA session.
+ */
+static error_t idaapi idcDecompile(idc_value_t* argv, idc_value_t* res)
+{
+	std::vector<func_t*> fncs;
+	if (idcPlugin == nullptr
+			|| getFunctions(splitString(argv[0].c_str(), " \t,;"), fncs)
+			|| fncs.empty())
+	{
+		res->set_long(-1);
+		return eOk;
+	}
+
+	std::string out = argv[1].c_str();
+	res->set_long(out.empty()
+			? idcPlugin->batchDecompilation(fncs, true) // redecompile
+			: idcPlugin->regressionDecompilation(fncs, out)
+	);
+	return eOk;
+}
+
+/**
+ * Make the config select only the given function.
+ */
+void selectFunction(retdec::config::Config& config, func_t* f)
+{
+	selectRange(config, f->start_ea, f->end_ea);
+}
+
+Function* RetDec::selectiveDecompilation(
+		ea_t ea,
+		bool redecompile,
+		bool regressionTests)
+{
+	func_t* f = getSelectedFunction(ea);
+	if (f == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (!redecompile)
+	{
+		if (auto* df = getDecompiledFunction(f))
+		{
+			return df;
+		}
+	}
+
+	ProfiledDecompilation profile(DecompilationJob::name(f->start_ea));
+	if (incrementalConfig.fill(config))
+	{
+		return nullptr;
+	}
+
+	std::string output;
+	std::string* out = &output;
+
+	selectFunction(config, f);
+
+	std::string cacheKey;
+	if (regressionTests)
+	{
+		config.parameters.setIsVerboseOutput(true);
+		config.parameters.setOutputFormat("plain");
+		config.parameters.setOutputFile(options.output.empty()
+				? config.parameters.getInputFile() + ".c"
+				: options.output
+		);
+		out = nullptr;
+	}
+	else if (diskCache.enabled())
+	{
+		cacheKey = DiskCache::key(config, f);
+		std::vector<Token> ts;
+		if (!diskCache.load(cacheKey, ts) && !ts.empty())
+		{
+			return setDecompiledFunction(f, ts);
+		}
+	}
+
+	show_wait_box("Decompiling...");
+	std::string error;
+	bool failed = false;
+	{
+		Profiler::Phase phase("decompile");
+		failed = runDecompilation(config, out, error);
+	}
+	decompilationStats.finished(failed, error);
+	if (failed)
+	{
+		hide_wait_box();
+		WARNING_GUI("Decompilation exception: " << error << std::endl);
+		return nullptr;
+	}
+	hide_wait_box();
+
+	if (out == nullptr)
+	{
+		return nullptr;
+	}
+
+	auto ts = parseTokens(output, f->start_ea);
+	if (ts.empty())
+	{
+		return nullptr;
+	}
+	if (!cacheKey.empty())
+	{
+		diskCache.store(cacheKey, ts);
+	}
+	return setDecompiledFunction(f, ts);
+}
+
+/**
+ * Decompile the functions in a single decompiler run into the file, with the
+ * same config as the regression tests of selectiveDecompilation() - RetDec
+ * itself writes its verbose plain output. In a worker process if possible,
+ * so that its limits apply. Returns the number of decompiled functions, 0 if
+ * the decompilation failed.
+ */
+std::size_t RetDec::regressionDecompilation(
+		const std::vector<func_t*>& fncs,
+		const std::string& out)
+{
+	ProfiledDecompilation profile("decompilation into " + out);
+	if (checkRelocatable() || incrementalConfig.fill(config))
+	{
+		return 0;
+	}
+
+	AddressRanges ranges;
+	for (func_t* f : fncs)
+	{
+		ranges.emplace_back(f->start_ea, f->end_ea);
+	}
+	config.parameters.setIsVerboseOutput(true);
+	config.parameters.setOutputFormat("plain");
+	config.parameters.setOutputFile(out);
+
+	show_wait_box("Decompiling...");
+	std::string error;
+	bool failed = false;
+	if (!workerProcess.empty())
+	{
+		// The worker selects the ranges and writes the output file.
+		Profiler::Phase phase("decompile.process");
+		WorkerProcess process(
+				workerProcess,
+				options.workerMaxMemory * 1024 * 1024,
+				options.timeout
+		);
+		std::string output;
+		failed = process.decompile(config, 0, ranges, output, error);
+		phase.setPeakRss(process.peakRss());
+	}
+	else
+	{
+		Profiler::Phase phase("decompile");
+		selectRanges(config, ranges);
+		failed = runDecompilation(config, nullptr, error);
+	}
+	hide_wait_box();
+
+	decompilationStats.finished(failed, error, fncs.size());
+	if (failed)
+	{
+		WARNING_GUI("Decompilation exception: " << error << std::endl);
+		return 0;
+	}
+	return fncs.size();
+}
+
+/**
+ * Returns the already decompiled function, or a placeholder function which is
+ * replaced by the real one once the background decompilation finishes.
+ */
+Function* RetDec::selectiveDecompilationAsync(ea_t ea, bool redecompile)
+{
+	using Priority = DecompilationJob::Priority;
+
+	func_t* f = getSelectedFunction(ea);
+	if (f == nullptr)
+	{
+		return nullptr;
+	}
+	auto name = DecompilationJob::name(f->start_ea);
+	Profiler::Decompilation profile(name);
+
+	// User navigated away from the functions that are still waiting.
+	//
+	for (ea_t start : worker.cancel(Priority::INTERACTIVE, f->start_ea))
+	{
+		decompilationCancelled(start);
+	}
+
+	Function* ret = nullptr;
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end() && worker.isPending(f->start_ea))
+	{
+		worker.prioritize(f->start_ea, Priority::INTERACTIVE);
+		ret = &it->second;
+	}
+	else if (!redecompile && (ret = getDecompiledFunction(f)))
+	{
+		// Already decompiled.
+	}
+	else if (auto cfg = getJobConfig())
+	{
+		ret = queueDecompilation(f, ea, Priority::INTERACTIVE, cfg);
+	}
+
+	if (ret)
+	{
+		prefetch(f);
+	}
+	// Queued decompilation is reported when it finishes.
+	if (!worker.isPending(f->start_ea))
+	{
+		printProfile(name);
+	}
+	return ret;
+}
+
+/**
+ * Decompile the given functions in the background, all of them in a single
+ * decompiler run. Loading of the input, type libraries, and the decompiler
+ * set-up are therefore done only once, not for every function.
+ * Functions which are already decompiled (unless \p redecompile), being
+ * decompiled, or in the shared decompilation cache are skipped.
+ *
+ * If \p out is given, the decompilation runs right away (e.g. when IDA runs
+ * a script in batch mode), and C code of all the decompiled functions is also
+ * written into this file.
+ *
+ * Returns the number of functions decompiled (\p out given) or queued for
+ * decompilation.
+ */
+std::size_t RetDec::batchDecompilation(
+		const std::vector<func_t*>& fncs,
+		bool redecompile,
+		const std::string& out)
+{
+	if (fncs.empty() || checkRelocatable())
+	{
+		return 0;
+	}
+	auto cfg = getJobConfig();
+	if (cfg == nullptr)
+	{
+		return 0;
+	}
+
+	DecompilationJob job;
+	job.priority = DecompilationJob::Priority::INTERACTIVE;
+	job.config = cfg;
+	job.configGeneration = jobConfigGeneration;
+
+	for (func_t* f : fncs)
+	{
+		if (segtype(f->start_ea) == SEG_XTRN
+				|| worker.isPending(f->start_ea)
+				|| (!redecompile && isDecompiled(f)))
+		{
+			continue;
+		}
+		if (out.empty() && diskCache.enabled())
+		{
+			std::vector<Token> ts;
+			if (!diskCache.load(DiskCache::key(*cfg, f), ts) && !ts.empty())
+			{
+				setDecompiledFunction(f, ts);
+				continue;
+			}
+		}
+
+		job.batch.emplace_back(f->start_ea, f->end_ea);
+		functionCache.update(&(fnc2fnc[f] = Function::placeholder(
+				f,
+				"// Decompiling, please wait..."
+		)));
+	}
+
+	auto count = job.batch.size();
+	if (count == 0)
+	{
+		return 0;
+	}
+	job.fncStart = job.batch.front().first;
+	job.fncEnd = job.batch.front().second;
+	job.ea = job.fncStart;
+
+	if (out.empty())
+	{
+		INFO_MSG("Batch decompilation: " << count << " functions queued\n");
+		worker.submit(std::move(job));
+		return count;
+	}
+
+	std::unique_ptr<WorkerProcess> process;
+	if (!workerProcess.empty())
+	{
+		process = std::make_unique<WorkerProcess>(
+				workerProcess,
+				options.workerMaxMemory * 1024 * 1024,
+				options.timeout
+		);
+	}
+	show_wait_box("Decompiling...");
+	Worker::run(job, process.get());
+	hide_wait_box();
+
+	if (!job.failed)
+	{
+		std::ofstream ofs(out, std::ios::binary);
+		for (auto& t : parseTokens(job.output, BADADDR))
+		{
+			ofs << t.value;
+		}
+		if (!ofs)
+		{
+			WARNING_GUI("Unable to write " << out << std::endl);
+		}
+	}
+	return batchDecompilationFinished(job);
+}
+
+/**
+ * Called on the UI thread when the background batch decompilation finishes.
+ * The output is split into the individual functions.
+ */
+std::size_t RetDec::batchDecompilationFinished(DecompilationJob& job)
+{
+	ProfiledDecompilation profile(job.name());
+	std::map<ea_t, std::vector<Token>> outputs;
+	if (job.failed)
+	{
+		WARNING_GUI("Decompilation exception: " << job.error << std::endl);
+	}
+	else
+	{
+		outputs = splitTokens(parseTokens(job.output, BADADDR));
+	}
+
+	std::size_t decompiled = 0;
+	for (auto& r : job.batch)
+	{
+		// Function might have been deleted in the meantime.
+		func_t* f = get_func(r.first);
+		if (f == nullptr || f->start_ea != r.first)
+		{
+			continue;
+		}
+
+		Function* F = nullptr;
+		auto it = outputs.find(r.first);
+		if (it == outputs.end())
+		{
+			F = &(fnc2fnc[f] = Function::placeholder(f, "// Decompilation failed."));
+			functionCache.update(F);
+		}
+		else
+		{
+			// Functions of the batch are looked up one by one, see
+			// batchDecompilation().
+			if (diskCache.enabled() && job.config)
+			{
+				diskCache.store(DiskCache::key(*job.config, f), it->second);
+			}
+			F = setDecompiledFunction(f, it->second);
+			++decompiled;
+		}
+
+		if (fnc == F)
+		{
+			refreshFunction(F, f->start_ea);
+		}
+	}
+
+	decompilationStats.finished(job.failed, job.error, decompiled);
+	INFO_MSG("Batch decompilation: " << decompiled << " of "
+			<< job.batch.size() << " functions decompiled\n");
+	return decompiled;
+}
+
+/**
+ * Get the function from the shared decompilation cache, or queue its
+ * decompilation and return a placeholder.
+ */
+Function* RetDec::queueDecompilation(
+		func_t* f,
+		ea_t ea,
+		DecompilationJob::Priority priority,
+		const std::shared_ptr<const retdec::config::Config>& cfg)
+{
+	DecompilationJob job;
+	job.priority = priority;
+	job.fncStart = f->start_ea;
+	job.fncEnd = f->end_ea;
+	job.ea = ea;
+	job.config = cfg;
+	job.configGeneration = jobConfigGeneration;
+
+	if (diskCache.enabled())
+	{
+		Profiler::Decompilation profile(job.name());
+		job.cacheKey = DiskCache::key(*job.config, f);
+		std::vector<Token> ts;
+		if (!diskCache.load(job.cacheKey, ts) && !ts.empty())
+		{
+			auto* F = setDecompiledFunction(f, ts);
+			printProfile(job.name());
+			return F;
+		}
+	}
+
+	worker.submit(std::move(job));
+
+	auto* F = &(fnc2fnc[f] = Function::placeholder(
+			f,
+			"// Decompiling, please wait..."
+	));
+	functionCache.update(F);
+	return F;
+}
+
+/**
+ * Config for decompilation jobs. Jobs share one copy until IDB changes.
+ * Returns \c nullptr if something went wrong.
+ */
+std::shared_ptr<const retdec::config::Config> RetDec::getJobConfig()
+{
+	if (incrementalConfig.fill(config))
+	{
+		return nullptr;
+	}
+
+	if (jobConfig == nullptr
+			|| jobConfigGeneration != incrementalConfig.generation())
+	{
+		Profiler::Phase phase("config.copy");
+		auto c = std::make_shared<retdec::config::Config>(config);
+		c->parameters.setOutputFormat("json");
+		jobConfig = c;
+		jobConfigGeneration = incrementalConfig.generation();
+	}
+	return jobConfig;
+}
+
+/**
+ * Functions directly called by the given function, then the functions
+ * calling it.
+ */
+std::vector<func_t*> getCallGraphNeighbours(func_t* f)
+{
+	std::vector<func_t*> ret;
+	auto isCall = [] (const xrefblk_t& xb)
+	{
+		return xb.iscode && (xb.type == fl_CN || xb.type == fl_CF);
+	};
+
+	func_item_iterator_t fii(f);
+	for (bool ok = true; ok; ok = fii.next_code())
+	{
+		xrefblk_t xb;
+		for (bool x = xb.first_from(fii.current(), XREF_FAR); x; x = xb.next_from())
+		{
+			func_t* callee = get_func(xb.to);
+			if (isCall(xb) && callee && callee->start_ea == xb.to)
+			{
+				ret.push_back(callee);
+			}
+		}
+	}
+
+	xrefblk_t xb;
+	for (bool x = xb.first_to(f->start_ea, XREF_FAR); x; x = xb.next_to())
+	{
+		func_t* caller = get_func(xb.from);
+		if (isCall(xb) && caller)
+		{
+			ret.push_back(caller);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * Queue background decompilations of the functions the user will probably
+ * open next - callees and callers of the displayed function, breadth first,
+ * up to the configured depth and budget. Previously prefetched functions
+ * that are still waiting are dropped.
+ */
+void RetDec::prefetch(func_t* f)
+{
+	using Priority = DecompilationJob::Priority;
+
+	for (ea_t start : worker.cancel(Priority::BACKGROUND))
+	{
+		decompilationCancelled(start);
+	}
+
+	unsigned budget = options.prefetchBudget;
+	if (options.prefetchDepth == 0 || budget == 0)
+	{
+		return;
+	}
+	auto cfg = getJobConfig();
+	if (cfg == nullptr)
+	{
+		return;
+	}
+
+	std::set<ea_t> seen = {f->start_ea};
+	std::vector<func_t*> level = {f};
+	for (unsigned depth = 0; depth < options.prefetchDepth; ++depth)
+	{
+		std::vector<func_t*> next;
+		for (func_t* lf : level)
+		{
+			for (func_t* n : getCallGraphNeighbours(lf))
+			{
+				if (!seen.insert(n->start_ea).second)
+				{
+					continue;
+				}
+				next.push_back(n);
+
+				// Library functions and thunks are rarely opened.
+				if ((n->flags & (FUNC_LIB | FUNC_THUNK))
+						|| worker.isPending(n->start_ea)
+						|| isDecompiled(n))
+				{
+					continue;
+				}
+				auto* df = queueDecompilation(
+						n,
+						n->start_ea,
+						Priority::BACKGROUND,
+						cfg
+				);
+				if (df->isPlaceholder() && --budget == 0)
+				{
+					return;
+				}
+			}
+		}
+		level = std::move(next);
+	}
+}
+
+/**
+ * Called when a queued decompilation was dropped before it started.
+ */
+void RetDec::decompilationCancelled(ea_t fncStart)
+{
+	func_t* f = get_func(fncStart);
+	if (f == nullptr)
+	{
+		return;
+	}
 
-	INFO_MSG(pluginName << " version " << pluginVersion << " loaded OK\n");
+	// Do not leave the "please wait" placeholder behind, it would be shown
+	// e.g. when navigating back in the location history.
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end() && it->second.isPlaceholder())
+	{
+		it->second = notDecompiledPlaceholder(f);
+	}
 }
 
-bool runDecompilation(
-		retdec::config::Config& config,
-		std::string* output = nullptr)
+/**
+ * Called on the UI thread when the background decompilation finishes.
+ */
+void RetDec::decompilationFinished(DecompilationJob& job)
 {
-	try
+	if (!job.batch.empty())
 	{
-		auto rc = retdec::decompile(config, output);
-		if (rc != 0)
-		{
-			throw std::runtime_error(
-					"decompilation error code = " + std::to_string(rc)
-			);
-		}
+		batchDecompilationFinished(job);
+		return;
 	}
-	catch (const std::runtime_error& e)
+	ProfiledDecompilation profile(job.name());
+	decompilationStats.finished(job.failed, job.error);
+
+	// Function might have been deleted in the meantime.
+	func_t* f = get_func(job.fncStart);
+	if (f == nullptr || f->start_ea != job.fncStart)
 	{
-		WARNING_GUI("Decompilation exception: " << e.what() << std::endl);
-		return true;
+		return;
 	}
-	catch (...)
+
+	std::vector<Token> ts;
+	if (job.failed && job.priority == DecompilationJob::Priority::INTERACTIVE)
 	{
-		WARNING_GUI("Decompilation exception: unknown" << std::endl);
-		return true;
+		WARNING_GUI("Decompilation exception: " << job.error << std::endl);
+	}
+	else if (job.failed)
+	{
+		// Do not bother the user with functions they did not ask for.
+		WARNING_MSG("Decompilation of " << std::hex << job.fncStart
+				<< std::dec << " failed: " << job.error << std::endl);
+	}
+	else
+	{
+		ts = parseTokens(job.output, f->start_ea);
 	}
 
-	return false;
+	// Assign into the existing map value, the displayed function keeps
+	// pointing to it. Places notice the change by its generation.
+	Function* F = nullptr;
+	if (ts.empty())
+	{
+		F = &(fnc2fnc[f] = Function::placeholder(f, "// Decompilation failed."));
+		functionCache.update(F);
+	}
+	else
+	{
+		if (!job.cacheKey.empty())
+		{
+			diskCache.store(job.cacheKey, ts);
+		}
+		F = setDecompiledFunction(f, ts);
+	}
+
+	if (fnc == F)
+	{
+		refreshFunction(F, job.ea);
+	}
 }
 
-Function* RetDec::selectiveDecompilation(
-		ea_t ea,
-		bool redecompile,
-		bool regressionTests)
+/**
+ * Get already decompiled function - either from this session, or from IDB.
+ * Returns \c nullptr if the function was not decompiled yet.
+ */
+Function* RetDec::getDecompiledFunction(func_t* f)
 {
-	if (isRelocatable() && inf_get_min_ea() != 0)
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end() && !it->second.isPlaceholder())
 	{
-		WARNING_GUI("RetDec plugin can selectively decompile only "
-				"relocatable objects loaded at 0x0.\n"
-				"Rebase the program to 0x0 or use full decompilation."
-		);
-		return nullptr;
+		// Released function is loaded again, unless IDB lost it.
+		auto* F = functionCache.touch(&it->second);
+		return F->isPlaceholder() ? nullptr : F;
 	}
 
-	func_t* f = get_func(ea);
-	if (f == nullptr)
+	std::vector<Token> ts;
+	if (IdbCache::load(f->start_ea, ts) || ts.empty())
 	{
-		WARNING_GUI("Function must be selected by the cursor.\n");
 		return nullptr;
 	}
+	auto* F = &(fnc2fnc[f] = Function(f, ts));
+	identifiers.add(f, *F);
+	functionCache.update(F);
+	functionCache.loaded(F);
+	return F;
+}
 
-	if (!redecompile)
+/**
+ * Was the function already decompiled - either in this session, or is it in
+ * IDB? Unlike getDecompiledFunction(), this never loads the function.
+ */
+bool RetDec::isDecompiled(func_t* f)
+{
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end() && !it->second.isPlaceholder())
 	{
-		auto it = fnc2fnc.find(f);
-		if (it != fnc2fnc.end())
-		{
-			return &it->second;
-		}
+		return true;
 	}
+	return IdbCache::contains(f->start_ea);
+}
+
+/**
+ * Remember the decompiled function - both in this session and in IDB.
+ */
+Function* RetDec::setDecompiledFunction(
+		func_t* f,
+		const std::vector<Token>& tokens)
+{
+	Profiler::Phase phase("function");
+	auto* F = &(fnc2fnc[f] = Function(f, tokens));
+	// Function's tokens, not the given ones - their indexes are the same as
+	// in the identifier index, see IdbCache::renameTokens().
+	IdbCache::store(f->start_ea, F->getTokens());
+	identifiers.add(f, *F);
+	functionCache.update(F);
+	return F;
+}
 
-	if (fillConfig(config))
+/**
+ * Get function for a place restored from IDB (e.g. location history).
+ * This never decompiles, functions which were not decompiled yet are replaced
+ * by placeholders.
+ */
+Function* RetDec::getRestoredFunction(ea_t ea)
+{
+	func_t* f = get_func(ea);
+	if (f == nullptr)
 	{
 		return nullptr;
 	}
 
-	std::set<ea_t> selectedFncs;
-	std::string output;
-	std::string* out = &output;
-
-	config.parameters.setOutputFormat("json");
-	retdec::common::AddressRange r(f->start_ea, f->end_ea);
-	config.parameters.selectedRanges.insert(r);
-	selectedFncs.insert(f->start_ea);
-	config.parameters.setIsSelectedDecodeOnly(true);
+	if (auto* df = getDecompiledFunction(f))
+	{
+		return df;
+	}
 
-	if (regressionTests)
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end())
 	{
-		config.parameters.setIsVerboseOutput(true);
-		config.parameters.setOutputFormat("plain");
-		config.parameters.setOutputFile(config.parameters.getInputFile() + ".c");
-		out = nullptr;
+		return &it->second;
 	}
+	auto* F = &(fnc2fnc[f] = notDecompiledPlaceholder(f));
+	functionCache.update(F);
+	return F;
+}
 
-	show_wait_box("Decompiling...");
-	if (runDecompilation(config, out))
+/**
+ * Get function of a place, see retdec_place_t::fnc().
+ * Returns \c nullptr if the IDA function no longer exists.
+ */
+Function* RetDec::getPlaceFunction(ea_t fncStart)
+{
+	func_t* f = get_func(fncStart);
+	if (f == nullptr)
 	{
-		hide_wait_box();
 		return nullptr;
 	}
-	hide_wait_box();
 
-	if (out == nullptr)
+	// Placeholders of functions being decompiled are returned as they are,
+	// without looking into IDB on every repaint. IDA resolves places all the
+	// time, this is not a use of the function.
+	auto it = fnc2fnc.find(f);
+	if (it != fnc2fnc.end())
 	{
-		return nullptr;
+		return functionCache.touch(&it->second);
 	}
+	return getRestoredFunction(fncStart);
+}
 
-	auto ts = parseTokens(output, f->start_ea);
-	if (ts.empty())
+Function RetDec::notDecompiledPlaceholder(func_t* f)
+{
+	return Function::placeholder(
+			f,
+			"// Not decompiled yet. Press " + pluginHotkey + " to decompile."
+	);
+}
+
+/**
+ * Function's code changed, or the function is being deleted - its decompiled
+ * code is removed from IDB, and the one in memory is replaced by a
+ * placeholder (pointers to it stay valid).
+ */
+void RetDec::forgetDecompiledFunction(func_t* f)
+{
+	IdbCache::remove(f->start_ea);
+
+	// Placeholders of functions being decompiled are replaced by the result.
+	auto it = fnc2fnc.find(f);
+	if (it == fnc2fnc.end() || it->second.isPlaceholder())
 	{
-		return nullptr;
+		return;
 	}
-	return &(fnc2fnc[f] = Function(f, ts));
+	identifiers.remove(f);
+	functionCache.update(&(it->second = notDecompiledPlaceholder(f)));
 }
 
 Function* RetDec::selectiveDecompilationAndDisplay(ea_t ea, bool redecompile)
 {
-	auto* f = selectiveDecompilation(ea, redecompile);
+	auto* f = selectiveDecompilationAsync(ea, redecompile);
 	if (f)
 	{
 		displayFunction(f, ea);
@@ -183,7 +1076,7 @@ Function* RetDec::selectiveDecompilationAndDisplay(ea_t ea, bool redecompile)
 
 void RetDec::displayFunction(Function* f, ea_t ea)
 {
-	fnc = f;
+	fnc = functionCache.use(f);
 
 	retdec_place_t min(fnc, fnc->min_yx());
 	retdec_place_t max(fnc, fnc->max_yx());
@@ -228,9 +1121,32 @@ void RetDec::displayFunction(Function* f, ea_t ea)
 	return;
 }
 
+/**
+ * Update the displayed function after its content changed.
+ * Unlike displayFunction(), this does not steal focus from other widgets.
+ */
+void RetDec::refreshFunction(Function* f, ea_t ea)
+{
+	if (custViewer == nullptr)
+	{
+		return;
+	}
+	functionCache.use(f);
+
+	retdec_place_t min(f, f->min_yx());
+	retdec_place_t max(f, f->max_yx());
+	retdec_place_t cur(f, f->ea_2_yx(ea));
+
+	set_custom_viewer_range(custViewer, &min, &max);
+	jumpto(custViewer, &cur, cur.x(), cur.y());
+	refresh_custom_viewer(custViewer);
+}
+
 bool RetDec::fullDecompilation()
 {
-	std::string defaultOut = getInputPath() + ".c";
+	std::string defaultOut = options.output.empty()
+			? getInputPath() + ".c"
+			: options.output;
 
 	char *tmp = ask_file(                // Returns: file name
 			true,                        // bool for_saving
@@ -245,20 +1161,298 @@ bool RetDec::fullDecompilation()
 	std::string out = tmp;
 
 	INFO_MSG("Selected file: " << out << "\n");
+	ProfiledDecompilation profile("full decompilation");
 
-	if (fillConfig(config, out))
+	if (incrementalConfig.fill(config, out))
 	{
 		return false;
 	}
 	config.parameters.setOutputFormat("c");
 
+	// Shards pay off only when they are decompiled in parallel.
+	if (!workerProcess.empty() && options.workers > 1)
+	{
+		fullDecompilationSharded(out);
+		return true;
+	}
+
 	show_wait_box("Decompiling...");
-	runDecompilation(config);
+	std::string error;
+	bool failed = false;
+	if (!workerProcess.empty())
+	{
+		// The whole input in one worker process, within its limits. The
+		// decompiler writes the output file.
+		Profiler::Phase phase("decompile.process");
+		WorkerProcess process(
+				workerProcess,
+				options.workerMaxMemory * 1024 * 1024,
+				options.timeout
+		);
+		std::string output;
+		failed = process.decompile(config, 0, {}, output, error);
+		phase.setPeakRss(process.peakRss());
+	}
+	else
+	{
+		// Background decompilation in this process is not interrupted, this
+		// waits until its running job finishes (see runDecompilation()).
+		Profiler::Phase phase("decompile");
+		failed = runDecompilation(config, nullptr, error);
+	}
 	hide_wait_box();
+	decompilationStats.finished(failed, error, get_func_qty());
+	if (failed)
+	{
+		WARNING_GUI("Decompilation exception: " << error << std::endl);
+	}
 
 	return true;
 }
 
+/**
+ * Full decompilation split into shards of functions with about the same size,
+ * which are decompiled in parallel by worker processes. All the shards use
+ * the same config. Their outputs are merged into the output file.
+ *
+ * Functions decompiled by the previous full decompilation into the same file
+ * are kept in a manifest next to it, and reused if nothing their
+ * decompilation depends on changed (see DiskCache::key()).
+ */
+void RetDec::fullDecompilationSharded(const std::string& out)
+{
+	auto manifestPath = out + ".manifest";
+	Manifest previous;
+	if (!fs::exists(out) || previous.load(manifestPath))
+	{
+		previous = Manifest();
+	}
+
+	Manifest manifest;
+	AddressRanges fncs;
+	std::vector<std::string> reused;
+	for (func_t* f = get_next_func(0); f; f = get_next_func(f->start_ea))
+	{
+		// Imported functions are only declared.
+		if (segtype(f->start_ea) == SEG_XTRN)
+		{
+			continue;
+		}
+
+		auto& entry = manifest.functions[f->start_ea];
+		entry.key = DiskCache::key(config, f);
+		auto it = previous.functions.find(f->start_ea);
+		if (it != previous.functions.end() && it->second.key == entry.key)
+		{
+			entry.code = std::move(it->second.code);
+			reused.push_back(entry.code);
+		}
+		else
+		{
+			fncs.emplace_back(f->start_ea, f->end_ea);
+		}
+	}
+	INFO_MSG("Full decompilation: " << fncs.size() << " functions to "
+			<< "decompile, " << reused.size() << " unchanged functions "
+			<< "reused from " << manifestPath << "\n");
+
+	// More shards than workers, so that the progress is visible, and the
+	// result of a cancelled decompilation is not empty.
+	auto shards = partitionFunctions(
+			fncs,
+			options.workers * shardsPerWorker
+	);
+
+	retdec::config::Config shardConfig = config;
+	shardConfig.parameters.setOutputFile("");
+
+	std::vector<std::string> outputs(shards.size());
+	std::vector<std::string> errors(shards.size(), "decompilation cancelled");
+	std::vector<char> failed(shards.size(), true);
+
+	// Shards are taken by the worker threads in turns. Threads only drive the
+	// worker processes, they do not touch IDA API.
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::size_t> finished;
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> cancelled(false);
+	std::vector<std::unique_ptr<WorkerProcess>> processes;
+	std::vector<std::thread> threads;
+	auto threadCount = std::min<std::size_t>(options.workers, shards.size());
+	for (std::size_t t = 0; t < threadCount; ++t)
+	{
+		processes.push_back(std::make_unique<WorkerProcess>(
+				workerProcess,
+				options.workerMaxMemory * 1024 * 1024,
+				options.timeout
+		));
+		threads.emplace_back([&, process = processes.back().get()]
+		{
+			Profiler::Decompilation profile("full decompilation");
+			for (std::size_t i = next++;
+					i < shards.size() && !cancelled;
+					i = next++)
+			{
+				// All the shards share one config, which is therefore sent
+				// to each process only once.
+				Profiler::Phase phase("decompile.process");
+				std::string output;
+				std::string error;
+				bool f = process->decompile(
+						shardConfig,
+						1,
+						shards[i],
+						output,
+						error
+				);
+				phase.setPeakRss(process->peakRss());
+				std::lock_guard<std::mutex> lock(mutex);
+				failed[i] = f;
+				outputs[i] = std::move(output);
+				errors[i] = std::move(error);
+				finished.push_back(i);
+				cv.notify_one();
+			}
+		});
+	}
+
+	// Functions are written into the output file as soon as their shard
+	// is finished, the file is rewritten by the merged output at the end.
+	std::ofstream stream(out, std::ios::binary);
+	for (auto& f : reused)
+	{
+		stream << f << "\n";
+	}
+	stream.flush();
+
+	show_wait_box("Decompiling...");
+	std::size_t doneShards = 0;
+	std::size_t doneFunctions = 0;
+	auto processFinished = [&]
+	{
+		std::deque<std::size_t> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.swap(finished);
+		}
+		for (std::size_t i : ready)
+		{
+			++doneShards;
+			doneFunctions += shards[i].size();
+			if (failed[i])
+			{
+				continue;
+			}
+			for (auto& f : extractFunctions(outputs[i]))
+			{
+				stream << f.second << "\n";
+				auto it = manifest.functions.find(f.first);
+				if (it != manifest.functions.end())
+				{
+					it->second.code = std::move(f.second);
+				}
+			}
+		}
+		stream.flush();
+	};
+	while (doneShards < shards.size())
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait_for(lock, std::chrono::milliseconds(200), [&]
+			{
+				return !finished.empty();
+			});
+		}
+		processFinished();
+		replace_wait_box(
+				"Decompiling...\n%zu of %zu functions done",
+				doneFunctions,
+				fncs.size()
+		);
+		if (user_cancelled())
+		{
+			// Running decompilations would not stop otherwise.
+			cancelled = true;
+			for (auto& p : processes)
+			{
+				p->terminate();
+			}
+			break;
+		}
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	processFinished();
+	stream.close();
+	hide_wait_box();
+
+	// Decompilations killed by the cancellation.
+	if (cancelled)
+	{
+		for (std::size_t i = 0; i < shards.size(); ++i)
+		{
+			if (failed[i])
+			{
+				errors[i] = "decompilation cancelled";
+			}
+		}
+	}
+
+	// Functions of failed shards are listed at the top of the output.
+	std::vector<std::string> done;
+	std::stringstream failures;
+	failures << std::hex << std::showbase;
+	std::string error;
+	for (std::size_t i = 0; i < shards.size(); ++i)
+	{
+		decompilationStats.finished(failed[i], errors[i], shards[i].size());
+		if (!failed[i])
+		{
+			done.push_back(std::move(outputs[i]));
+			continue;
+		}
+		error = errors[i];
+		failures << "// Decompilation of the following functions failed ("
+				<< errors[i] << "):\n";
+		for (auto& r : shards[i])
+		{
+			failures << "//     " << r.first << "\n";
+		}
+	}
+	if (done.size() != shards.size() && !cancelled)
+	{
+		WARNING_GUI("Decompilation exception: " << error << std::endl);
+	}
+
+	std::string merged;
+	{
+		Profiler::Phase phase("merge");
+		merged = mergeShards(done, previous.declarations, reused);
+	}
+	std::ofstream ofs(out, std::ios::binary);
+	ofs << failures.str() << merged;
+	if (!ofs)
+	{
+		WARNING_GUI("Failed to write the decompiled file " << out << std::endl);
+		return;
+	}
+
+	// Functions which failed are decompiled again next time.
+	for (auto it = manifest.functions.begin(); it != manifest.functions.end();)
+	{
+		it = it->second.code.empty() ? manifest.functions.erase(it) : ++it;
+	}
+	manifest.declarations = stripFunctions(merged);
+	if (manifest.save(manifestPath))
+	{
+		WARNING_MSG("Failed to write " << manifestPath << "\n");
+	}
+}
+
 bool idaapi RetDec::run(size_t arg)
 {
 	if (!auto_is_ok())
@@ -283,30 +1477,20 @@ bool idaapi RetDec::run(size_t arg)
 		return fullDecompilation();
 	}
 	// regression tests selective decompilation
-	// function to decompile is marked by "<retdec_select>" string in comment
+	// function to decompile is given by "select" plugin option, or marked by
+	// "<retdec_select>" string in comment
 	//
 	else if (arg == 2)
 	{
-		for (unsigned i = 0; i < get_func_qty(); ++i)
+		auto fncs = getHeadlessFunctions();
+		if (fncs.empty())
 		{
-			qstring qCmt;
-			func_t *fnc = getn_func(i);
-			if (get_func_cmt(&qCmt, fnc, false) <= 0)
-			{
-				continue;
-			}
-
-			std::string cmt = qCmt.c_str();;
-			if (cmt.find("<retdec_select>") != std::string::npos)
-			{
-				auto r = selectiveDecompilation(
-						fnc->start_ea,
-						false, // redecompile
-						true); // regressionTests
-				return r;
-			}
+			return true;
 		}
-		return true;
+		return selectiveDecompilation(
+				fncs.front()->start_ea,
+				false, // redecompile
+				true); // regressionTests
 	}
 	// regression tests full decompilation
 	//
@@ -314,6 +1498,18 @@ bool idaapi RetDec::run(size_t arg)
 	{
 		return fullDecompilation();
 	}
+	// batch selective decompilation
+	// functions to decompile are given by "select" plugin option, or marked
+	// by "<retdec_select>" string in comment
+	//
+	else if (arg == 4)
+	{
+		return batchDecompilation(
+				getHeadlessFunctions(),
+				true, // redecompile
+				options.output.empty() ? getInputPath() + ".c" : options.output
+		) > 0;
+	}
 	else
 	{
 		WARNING_GUI(pluginName << " version " << pluginVersion
@@ -325,9 +1521,83 @@ bool idaapi RetDec::run(size_t arg)
 	return true;
 }
 
+/**
+ * Start background decompilation - in worker processes if possible.
+ */
+void RetDec::startWorker()
+{
+	auto process = retdec::utils::getThisBinaryDirectoryPath();
+	process.append("plugins");
+	process.append("retdec");
+#ifdef _WIN32
+	process.append("retdec-idaplugin-worker.exe");
+#else
+	process.append("retdec-idaplugin-worker");
+#endif
+
+	if (options.workers == 0)
+	{
+		worker.start(1);
+	}
+	else if (!fs::exists(process))
+	{
+		WARNING_MSG("Decompilation worker " << process.string()
+				<< " not found, decompiling inside IDA.\n");
+		worker.start(1);
+	}
+	else
+	{
+		workerProcess = process.string();
+		worker.start(
+				options.workers,
+				workerProcess,
+				options.workerMaxMemory * 1024 * 1024,
+				options.timeout
+		);
+	}
+}
+
 RetDec::~RetDec()
 {
+	unhook_event_listener(HT_IDB, &idbListener);
 	unhook_event_listener(HT_UI, this);
+	// Not at the static destruction, the trimming thread must be joined
+	// before the plugin is unloaded.
+	diskCache.close();
+
+	if (idcPlugin == this)
+	{
+		del_idc_func(idcDecompile_desc.name);
+		idcPlugin = nullptr;
+	}
+
+	if (Profiler::enabled())
+	{
+		auto profile = Profiler::summary();
+		if (options.profile && !profile.empty())
+		{
+			INFO_MSG(profile);
+		}
+		if (!options.profileJson.empty()
+				&& Profiler::writeJson(options.profileJson))
+		{
+			WARNING_MSG("Failed to write " << options.profileJson << "\n");
+		}
+		if (!options.profileTrace.empty()
+				&& Profiler::writeTrace(options.profileTrace))
+		{
+			WARNING_MSG("Failed to write " << options.profileTrace << "\n");
+		}
+	}
+
+	auto& s = functionCache.stats();
+	if (s.hits || s.misses)
+	{
+		INFO_MSG("Decompiled functions in memory: " << s.hits << " hits, "
+				<< s.misses << " misses, " << s.evictions << " evictions, "
+				<< s.functions << " functions in " << s.bytes / 1024
+				<< " kB (peak " << s.peakBytes / 1024 << " kB)\n");
+	}
 }
 
 void RetDec::modifyFunctions(
@@ -335,40 +1605,85 @@ void RetDec::modifyFunctions(
 		const std::string& oldVal,
 		const std::string& newVal)
 {
-	for (auto& p : fnc2fnc)
+	if (IdentifierIndex::isIndexed(k))
 	{
-		modifyFunction(p.first, k, oldVal, newVal);
+		// Copied, renaming changes the index.
+		auto uses = identifiers.find(k, oldVal);
+		for (auto& p : uses)
+		{
+			auto renamed = modifyFunction(
+					p.first,
+					p.second,
+					k,
+					oldVal,
+					newVal
+			);
+			identifiers.rename(p.first, k, oldVal, newVal, renamed);
+		}
+	}
+	else
+	{
+		// Released functions are renamed only in IDB, loading all of them
+		// would evict the ones in use.
+		for (auto& p : fnc2fnc)
+		{
+			if (p.second.isPlaceholder())
+			{
+				continue;
+			}
+			if (p.second.isReleased())
+			{
+				IdbCache::renameTokens(
+						p.first->start_ea,
+						nullptr,
+						k,
+						oldVal,
+						newVal
+				);
+				continue;
+			}
+			auto ts = p.second.findTokens(k, oldVal);
+			modifyFunction(p.first, ts, k, oldVal, newVal);
+		}
 	}
 }
 
-void RetDec::modifyFunction(
+/**
+ * Rename the given tokens of the decompiled function in place - only the
+ * lines containing them are laid out again. Released function is renamed
+ * only in IDB.
+ */
+std::vector<std::size_t> RetDec::modifyFunction(
 		func_t* f,
+		const std::vector<std::size_t>& tokens,
 		Token::Kind k,
 		const std::string& oldVal,
 		const std::string& newVal)
 {
 	auto fIt = fnc2fnc.find(f);
-	if (fIt == fnc2fnc.end())
+	if (fIt == fnc2fnc.end() || fIt->second.isPlaceholder())
 	{
-		return;
+		return {};
 	}
 	Function& F = fIt->second;
-
-	std::vector<Token> newTokens;
-
-	for (auto& t : F.getTokens())
+	if (F.isReleased())
 	{
-		if (t.second.kind == k && t.second.value == oldVal)
-		{
-			newTokens.emplace_back(Token(k, t.second.ea, newVal));
-		}
-		else
-		{
-			newTokens.emplace_back(t.second);
-		}
+		return IdbCache::renameTokens(
+				f->start_ea,
+				&tokens,
+				k,
+				oldVal,
+				newVal
+		);
 	}
 
-	fIt->second = Function(f, newTokens);
+	auto renamed = F.renameTokens(tokens, k, oldVal, newVal);
+	if (!renamed.empty())
+	{
+		IdbCache::store(f->start_ea, F.getTokens());
+		functionCache.update(&F);
+	}
+	return renamed;
 }
 
 ea_t RetDec::getFunctionEa(const std::string& name)
@@ -381,18 +1696,7 @@ ea_t RetDec::getFunctionEa(const std::string& name)
 	}
 
 	// Use IDA.
-	for (unsigned i = 0; i < get_func_qty(); ++i)
-	{
-		func_t* f = getn_func(i);
-		qstring qFncName;
-		get_func_name(&qFncName, f->start_ea);
-		if (qFncName.c_str() == name)
-		{
-			return f->start_ea;
-		}
-	}
-
-	return BADADDR;
+	return functionNames.find(name);
 }
 
 func_t* RetDec::getIdaFunction(const std::string& name)
@@ -6,6 +6,7 @@
 #include <iomanip>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 
@@ -13,9 +14,16 @@
 #include <retdec/utils/filesystem.h>
 #include <retdec/utils/time.h>
 
+#include "cache.h"
+#include "config.h"
+#include "events.h"
 #include "function.h"
+#include "names.h"
+#include "options.h"
+#include "stats.h"
 #include "ui.h"
 #include "utils.h"
+#include "worker.h"
 
 /**
  * Plugin's global data.
@@ -54,28 +62,67 @@ class RetDec : public plugmod_t, public event_listener_t
 	//
 	public:
 		static bool fullDecompilation();
+		static void fullDecompilationSharded(const std::string& out);
 		static Function* selectiveDecompilation(
 				ea_t ea,
 				bool redecompile,
 				bool regressionTests = false
 		);
 
+		static Function* getDecompiledFunction(func_t* f);
+		static bool isDecompiled(func_t* f);
+		static Function* setDecompiledFunction(
+				func_t* f,
+				const std::vector<Token>& tokens
+		);
+		static Function* getRestoredFunction(ea_t ea);
+		static Function* getPlaceFunction(ea_t fncStart);
+		static Function notDecompiledPlaceholder(func_t* f);
+		static void forgetDecompiledFunction(func_t* f);
+
+		Function* selectiveDecompilationAsync(ea_t ea, bool redecompile);
+		std::size_t batchDecompilation(
+				const std::vector<func_t*>& fncs,
+				bool redecompile,
+				const std::string& out = std::string()
+		);
+		std::size_t batchDecompilationFinished(DecompilationJob& job);
+		std::size_t regressionDecompilation(
+				const std::vector<func_t*>& fncs,
+				const std::string& out
+		);
+		Function* queueDecompilation(
+				func_t* f,
+				ea_t ea,
+				DecompilationJob::Priority priority,
+				const std::shared_ptr<const retdec::config::Config>& cfg
+		);
+		std::shared_ptr<const retdec::config::Config> getJobConfig();
+		void prefetch(func_t* f);
+		void decompilationFinished(DecompilationJob& job);
+		void decompilationCancelled(ea_t fncStart);
+
 		Function* selectiveDecompilationAndDisplay(ea_t ea, bool redecompile);
 		void displayFunction(Function* f, ea_t ea);
+		void refreshFunction(Function* f, ea_t ea);
 
 		void modifyFunctions(
 				Token::Kind k,
 				const std::string& oldVal,
 				const std::string& newVal
 		);
-		void modifyFunction(
+		/// Returns indexes of the renamed tokens.
+		std::vector<std::size_t> modifyFunction(
 				func_t* f,
+				const std::vector<std::size_t>& tokens,
 				Token::Kind k,
 				const std::string& oldVal,
 				const std::string& newVal
 		);
 
 		ea_t getFunctionEa(const std::string& name);
+		/// IDA function names, see getFunctionEa().
+		static NameIndex functionNames;
 		func_t* getIdaFunction(const std::string& name);
 		ea_t getGlobalVarEa(const std::string& name);
 
@@ -84,15 +131,48 @@ class RetDec : public plugmod_t, public event_listener_t
 
 		/// All the decompiled functions.
 		static std::map<func_t*, Function> fnc2fnc;
+		/// Memory budget of fnc2fnc, functions must be accessed through
+		/// FunctionCache::use().
+		static FunctionCache functionCache;
+		/// Global identifiers used by the decompiled functions.
+		static IdentifierIndex identifiers;
 
 		/// Decompilation config.
 		static retdec::config::Config config;
+		/// Keeps the decompilation config in sync with IDB.
+		static IncrementalConfig incrementalConfig;
+		idbListener_t idbListener = idbListener_t(*this);
+		/// Copy of the config shared by decompilation jobs, and its
+		/// IncrementalConfig::generation().
+		std::shared_ptr<const retdec::config::Config> jobConfig;
+		std::uint64_t jobConfigGeneration = 0;
+
+		/// Plugin options.
+		static Options options;
+		/// Decompilation cache shared across IDBs.
+		static DiskCache diskCache;
+		/// Outcomes of the decompiler runs in this session.
+		static DecompilationStats decompilationStats;
+
+		/// Background decompilation of selected functions.
+		/// RetDec's LLVM-based pipeline keeps global state, therefore
+		/// concurrent decompilations must run in worker processes.
+		Worker worker = Worker([this] (DecompilationJob& job)
+		{
+			decompilationFinished(job);
+		});
+		void startWorker();
+		/// Decompilation worker executable, empty if decompiling inside IDA.
+		static std::string workerProcess;
+		/// Full decompilation is split into this many shards per worker.
+		inline static const unsigned shardsPerWorker = 8;
 
 	// UI.
 	//
 	public:
 		TWidget* custViewer = nullptr;
 		TWidget* codeViewer = nullptr;
+		StatisticsViewer statisticsViewer = StatisticsViewer(*this);
 
 		fullDecompilation_ah_t fullDecompilation_ah = fullDecompilation_ah_t(*this);
 		const action_desc_t fullDecompilation_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
@@ -105,6 +185,28 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		batchDecompilation_ah_t batchDecompilation_ah = batchDecompilation_ah_t(*this);
+		const action_desc_t batchDecompilation_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				batchDecompilation_ah_t::actionName,
+				batchDecompilation_ah_t::actionLabel,
+				&batchDecompilation_ah,
+				this,
+				batchDecompilation_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
+		showStatistics_ah_t showStatistics_ah = showStatistics_ah_t(*this);
+		const action_desc_t showStatistics_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				showStatistics_ah_t::actionName,
+				showStatistics_ah_t::actionLabel,
+				&showStatistics_ah,
+				this,
+				showStatistics_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		jump2asm_ah_t jump2asm_ah = jump2asm_ah_t(*this);
 		const action_desc_t jump2asm_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				jump2asm_ah_t::actionName,
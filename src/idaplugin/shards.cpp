@@ -0,0 +1,601 @@
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+
+#include "shards.h"
+
+std::vector<AddressRanges> partitionFunctions(
+		AddressRanges functions,
+		std::size_t shards)
+{
+	std::vector<AddressRanges> ret(std::max<std::size_t>(
+			1,
+			std::min(shards, functions.size())
+	));
+
+	std::stable_sort(functions.begin(), functions.end(), [](auto& a, auto& b)
+	{
+		return a.second - a.first > b.second - b.first;
+	});
+
+	// (total size, shard index) of the smallest shard on top.
+	using Load = std::pair<std::uint64_t, std::size_t>;
+	std::priority_queue<Load, std::vector<Load>, std::greater<Load>> loads;
+	for (std::size_t i = 0; i < ret.size(); ++i)
+	{
+		loads.push({0, i});
+	}
+	for (auto& f : functions)
+	{
+		auto l = loads.top();
+		loads.pop();
+		ret[l.second].push_back(f);
+		l.first += f.second - f.first;
+		loads.push(l);
+	}
+
+	for (auto& s : ret)
+	{
+		std::sort(s.begin(), s.end());
+	}
+	ret.erase(
+			std::remove_if(ret.begin(), ret.end(), [](auto& s)
+			{
+				return s.empty();
+			}),
+			ret.end()
+	);
+	return ret;
+}
+
+namespace {
+
+const std::string functionsSection  = "Functions";
+const std::string prototypesSection = "Function Prototypes";
+const std::string globalsSection    = "Global Variables";
+const std::string structsSection    = "Structures";
+const std::string metaSection       = "Meta-Information";
+const std::string functionsHeader =
+		"// ------------------------ Functions -------------------------";
+
+/**
+ * Section of RetDec's C output, which starts by a line like:
+ *     // ------------------------ Functions -------------------------
+ */
+struct Section
+{
+	std::string title;
+	std::string header;
+	std::vector<std::string> items;
+};
+
+/**
+ * Parsed C output: lines before the first section (header comment and
+ * includes), then the sections.
+ */
+struct Output
+{
+	std::vector<std::string> prologue;
+	std::vector<Section> sections;
+};
+
+bool isSectionHeader(const std::string& line, std::string& title)
+{
+	if (line.compare(0, 6, "// ---") != 0 || line.back() != '-')
+	{
+		return false;
+	}
+	auto b = line.find_first_not_of("- ", 3);
+	auto e = line.find_last_not_of("- ");
+	if (b == std::string::npos || e < b)
+	{
+		return false;
+	}
+	title = line.substr(b, e - b + 1);
+	return true;
+}
+
+/**
+ * Functions end by a closing brace on its own line, structures by an empty
+ * line, everything else is one item per line.
+ */
+void addLine(Section& s, const std::string& line, bool& open)
+{
+	if (s.title == functionsSection || s.title == structsSection)
+	{
+		if (!open && line.empty())
+		{
+			return;
+		}
+		if (!open)
+		{
+			s.items.emplace_back();
+			open = true;
+		}
+		bool end = s.title == functionsSection ? line == "}" : line.empty();
+		if (!end || !line.empty())
+		{
+			s.items.back() += line;
+			s.items.back() += '\n';
+		}
+		open = !end;
+	}
+	else if (!line.empty())
+	{
+		s.items.push_back(line + '\n');
+	}
+}
+
+Output parseOutput(const std::string& str)
+{
+	Output ret;
+	Section* section = nullptr;
+	bool open = false;
+
+	std::istringstream in(str);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		std::string title;
+		if (isSectionHeader(line, title))
+		{
+			ret.sections.push_back({title, line, {}});
+			section = &ret.sections.back();
+			open = false;
+		}
+		else if (section)
+		{
+			addLine(*section, line, open);
+		}
+		else if (!line.empty())
+		{
+			ret.prologue.push_back(line);
+		}
+	}
+
+	return ret;
+}
+
+bool isIdChar(char c)
+{
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/**
+ * Name of the declared object, used to detect the same object declared in
+ * multiple shards, e.g. "function_401000" for:
+ *     int32_t function_401000(int32_t a1);
+ * Returns the whole declaration if the name can not be determined.
+ */
+std::string declarationName(const std::string& decl, const std::string& stops)
+{
+	auto code = decl.substr(0, decl.find("//"));
+	auto end = code.find_first_of(stops);
+	if (end == std::string::npos)
+	{
+		return decl;
+	}
+	code.resize(end);
+	auto arr = code.find('[');
+	if (arr != std::string::npos)
+	{
+		code.resize(arr);
+	}
+
+	auto e = code.size();
+	while (e && !isIdChar(code[e - 1]))
+	{
+		--e;
+	}
+	auto b = e;
+	while (b && isIdChar(code[b - 1]))
+	{
+		--b;
+	}
+	return b < e ? code.substr(b, e - b) : decl;
+}
+
+void addIdentifiers(const std::string& code, std::set<std::string>& ids)
+{
+	for (std::size_t i = 0; i < code.size();)
+	{
+		if (!isIdChar(code[i]))
+		{
+			++i;
+			continue;
+		}
+		auto b = i;
+		while (i < code.size() && isIdChar(code[i]))
+		{
+			++i;
+		}
+		ids.insert(code.substr(b, i - b));
+	}
+}
+
+std::uint64_t functionAddress(const std::string& fnc)
+{
+	const std::string prefix = "// Address range: ";
+	auto pos = fnc.find(prefix);
+	if (pos == std::string::npos)
+	{
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+	try
+	{
+		return std::stoull(fnc.substr(pos + prefix.size()), nullptr, 0);
+	}
+	catch (const std::logic_error&)
+	{
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+}
+
+std::string itemKey(const std::string& title, const std::string& item)
+{
+	if (title == prototypesSection)
+	{
+		return declarationName(item, "(");
+	}
+	else if (title == globalsSection)
+	{
+		// Function pointers would be named by their return type.
+		auto name = declarationName(item, "=;");
+		return item.find('(') < item.find('=') ? item : name;
+	}
+	return item;
+}
+
+} // anonymous namespace
+
+std::string mergeShards(
+		const std::vector<std::string>& outputs,
+		const std::string& previous,
+		const std::vector<std::string>& functions)
+{
+	std::vector<Output> parsed;
+	for (auto& o : outputs)
+	{
+		parsed.push_back(parseOutput(o));
+	}
+
+	// Previous output is merged as if it was the last shard.
+	if (!previous.empty() || !functions.empty())
+	{
+		parsed.push_back(parseOutput(previous));
+		auto& p = parsed.back();
+		auto it = std::find_if(p.sections.begin(), p.sections.end(), [](auto& s)
+		{
+			return s.title == functionsSection;
+		});
+		if (it == p.sections.end())
+		{
+			it = p.sections.insert(
+					p.sections.end(),
+					{functionsSection, functionsHeader, {}}
+			);
+		}
+		it->items.insert(it->items.end(), functions.begin(), functions.end());
+	}
+
+	// Identifiers used by the merged functions - stale declarations from the
+	// previous output are dropped.
+	std::set<std::string> used;
+	for (auto& p : parsed)
+	{
+		for (auto& s : p.sections)
+		{
+			if (s.title == functionsSection)
+			{
+				for (auto& f : s.items)
+				{
+					addIdentifiers(f, used);
+				}
+			}
+		}
+	}
+
+	// Names of the functions defined in each output - their prototypes are
+	// the most accurate ones.
+	std::vector<std::set<std::string>> defined(parsed.size());
+	for (std::size_t i = 0; i < parsed.size(); ++i)
+	{
+		for (auto& s : parsed[i].sections)
+		{
+			if (s.title != functionsSection)
+			{
+				continue;
+			}
+			for (auto& f : s.items)
+			{
+				std::istringstream in(f);
+				std::string line;
+				while (std::getline(in, line) && line.compare(0, 2, "//") == 0)
+				{
+					// Skip the address range and other comments.
+				}
+				defined[i].insert(declarationName(line, "("));
+			}
+		}
+	}
+
+	// Section order - sections missing in the first output are placed after
+	// the section preceding them in the output where they are present.
+	std::vector<const Section*> order;
+	for (auto& p : parsed)
+	{
+		auto pos = order.begin();
+		for (auto& s : p.sections)
+		{
+			auto it = std::find_if(order.begin(), order.end(), [&](auto* o)
+			{
+				return o->title == s.title;
+			});
+			pos = it != order.end() ? it + 1 : order.insert(pos, &s) + 1;
+		}
+	}
+
+	std::string ret;
+
+	// Header comment of the first output which has one, includes of all the
+	// outputs.
+	std::set<std::string> includes;
+	for (auto& p : parsed)
+	{
+		bool header = ret.empty();
+		for (auto& l : p.prologue)
+		{
+			if (l.compare(0, 8, "#include") == 0)
+			{
+				includes.insert(l);
+			}
+			else if (header)
+			{
+				ret += l + '\n';
+			}
+		}
+	}
+	if (!includes.empty())
+	{
+		ret += '\n';
+		for (auto& i : includes)
+		{
+			ret += i + '\n';
+		}
+	}
+
+	std::size_t functionCount = 0;
+	for (auto* section : order)
+	{
+		auto& title = section->title;
+		std::vector<std::string> items;
+		// Item key -> (index in items, is it a prototype of a function
+		// defined in the same output).
+		std::map<std::string, std::pair<std::size_t, bool>> keys;
+		for (std::size_t p = 0; p < parsed.size(); ++p)
+		{
+			for (auto& s : parsed[p].sections)
+			{
+				if (s.title != title)
+				{
+					continue;
+				}
+				for (auto& i : s.items)
+				{
+					auto key = itemKey(title, i);
+					if (p >= outputs.size()
+							&& (title == prototypesSection
+									|| title == globalsSection)
+							&& key != i
+							&& !used.count(key))
+					{
+						continue;
+					}
+					bool own = title == prototypesSection
+							&& defined[p].count(key);
+					auto it = keys.find(key);
+					if (it == keys.end())
+					{
+						keys[key] = {items.size(), own};
+						items.push_back(i);
+					}
+					else if (own && !it->second.second)
+					{
+						it->second.second = true;
+						items[it->second.first] = i;
+					}
+				}
+			}
+		}
+
+		if (title == functionsSection)
+		{
+			std::stable_sort(items.begin(), items.end(), [](auto& a, auto& b)
+			{
+				return functionAddress(a) < functionAddress(b);
+			});
+			functionCount = items.size();
+		}
+		else if (title == metaSection)
+		{
+			// Per-shard values are meaningless for the merged output.
+			items.erase(
+					std::remove_if(items.begin(), items.end(), [](auto& i)
+					{
+						return i.compare(0, 23, "// Decompilation time: ") == 0
+								|| i.compare(0, 22, "// Detected functions:") == 0;
+					}),
+					items.end()
+			);
+			items.push_back(
+					"// Detected functions: "
+					+ std::to_string(functionCount) + '\n'
+			);
+		}
+
+		ret += '\n' + section->header + "\n\n";
+		bool blocks = title == functionsSection || title == structsSection;
+		for (std::size_t i = 0; i < items.size(); ++i)
+		{
+			if (blocks && i)
+			{
+				ret += '\n';
+			}
+			ret += items[i];
+		}
+	}
+
+	return ret;
+}
+
+std::map<std::uint64_t, std::string> extractFunctions(const std::string& output)
+{
+	std::map<std::uint64_t, std::string> ret;
+	for (auto& s : parseOutput(output).sections)
+	{
+		if (s.title != functionsSection)
+		{
+			continue;
+		}
+		for (auto& f : s.items)
+		{
+			auto addr = functionAddress(f);
+			if (addr != std::numeric_limits<std::uint64_t>::max())
+			{
+				ret.emplace(addr, f);
+			}
+		}
+	}
+	return ret;
+}
+
+std::string stripFunctions(const std::string& output)
+{
+	std::string ret;
+	bool functions = false;
+
+	std::istringstream in(output);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::string title;
+		if (isSectionHeader(line, title))
+		{
+			functions = title == functionsSection;
+		}
+		else if (functions)
+		{
+			continue;
+		}
+		ret += line + '\n';
+	}
+
+	return ret;
+}
+
+//
+//==============================================================================
+// Manifest
+//==============================================================================
+//
+
+namespace {
+
+const std::string manifestMagic = "retdec-idaplugin-manifest-1\n";
+
+void writeString(std::ostream& out, const std::string& str)
+{
+	out << protocol::encodeSize(str.size()) << str;
+}
+
+bool readSize(const std::string& data, std::size_t& pos, std::uint64_t& size)
+{
+	if (data.size() - pos < protocol::sizeLength)
+	{
+		return true;
+	}
+	size = protocol::decodeSize(&data[pos]);
+	pos += protocol::sizeLength;
+	return false;
+}
+
+bool readString(const std::string& data, std::size_t& pos, std::string& str)
+{
+	std::uint64_t size = 0;
+	if (readSize(data, pos, size) || data.size() - pos < size)
+	{
+		return true;
+	}
+	str = data.substr(pos, size);
+	pos += size;
+	return false;
+}
+
+} // anonymous namespace
+
+bool Manifest::load(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good())
+	{
+		return true;
+	}
+	std::string data(
+			(std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>()
+	);
+
+	if (data.compare(0, manifestMagic.size(), manifestMagic) != 0)
+	{
+		return true;
+	}
+	std::size_t pos = manifestMagic.size();
+
+	std::uint64_t count = 0;
+	if (readSize(data, pos, count))
+	{
+		return true;
+	}
+	for (std::uint64_t i = 0; i < count; ++i)
+	{
+		std::uint64_t start = 0;
+		Entry e;
+		if (readSize(data, pos, start)
+				|| readString(data, pos, e.key)
+				|| readString(data, pos, e.code))
+		{
+			return true;
+		}
+		functions.emplace(start, std::move(e));
+	}
+
+	return readString(data, pos, declarations);
+}
+
+bool Manifest::save(const std::string& path) const
+{
+	std::ofstream out(path, std::ios::binary);
+	out << manifestMagic << protocol::encodeSize(functions.size());
+	for (auto& f : functions)
+	{
+		out << protocol::encodeSize(f.first);
+		writeString(out, f.second.key);
+		writeString(out, f.second.code);
+	}
+	writeString(out, declarations);
+	return !out;
+}
@@ -0,0 +1,76 @@
+
+#ifndef RETDEC_SHARDS_H
+#define RETDEC_SHARDS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "decompilation.h"
+
+// Sharded full decompilation. Nothing in here uses IDA API.
+
+/**
+ * Split functions into at most \p shards groups with about the same total
+ * size (the largest functions are placed first, each into the currently
+ * smallest group). Functions in each group are sorted by address.
+ * @param functions Address ranges of the functions.
+ * @param shards    Maximum number of groups.
+ */
+std::vector<AddressRanges> partitionFunctions(
+		AddressRanges functions,
+		std::size_t shards
+);
+
+/**
+ * Merge C outputs of shards decompiled with the same config into a single
+ * C output.
+ *
+ * Sections of the outputs (structures, prototypes, global variables, ...)
+ * are merged in their usual order. Declarations repeated in multiple shards
+ * are emitted only once (the first one wins), functions are sorted by their
+ * addresses.
+ *
+ * @param outputs   C outputs of the shards.
+ * @param previous  Declarations of a previous merged output (see
+ *                  stripFunctions()). Its prototypes and global variables
+ *                  are used only if the merged functions use them.
+ * @param functions Functions reused from a previous merged output.
+ */
+std::string mergeShards(
+		const std::vector<std::string>& outputs,
+		const std::string& previous = std::string(),
+		const std::vector<std::string>& functions = {}
+);
+
+/// Functions in the C output, indexed by their start addresses.
+std::map<std::uint64_t, std::string> extractFunctions(const std::string& output);
+/// C output without the functions.
+std::string stripFunctions(const std::string& output);
+
+/**
+ * Functions of a full decompilation kept for the next full decompilation of
+ * the same input, so that only the changed functions are decompiled again.
+ */
+struct Manifest
+{
+	struct Entry
+	{
+		/// Hash of everything the function's decompilation depends on.
+		std::string key;
+		/// C code of the function.
+		std::string code;
+	};
+	/// Function start -> entry.
+	std::map<std::uint64_t, Entry> functions;
+	/// Merged output without the functions.
+	std::string declarations;
+
+	/// Returns \c true if something went wrong.
+	bool load(const std::string& path);
+	/// Returns \c true if something went wrong.
+	bool save(const std::string& path) const;
+};
+
+#endif
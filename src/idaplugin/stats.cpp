@@ -0,0 +1,229 @@
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "profiler.h"
+#include "retdec.h"
+#include "stats.h"
+
+//
+//==============================================================================
+// DecompilationStats
+//==============================================================================
+//
+
+void DecompilationStats::finished(
+		bool failed,
+		const std::string& error,
+		std::size_t functions)
+{
+	++runs;
+	if (failed)
+	{
+		++failures;
+		++errors[error];
+	}
+	else
+	{
+		this->functions += functions;
+	}
+}
+
+//
+//==============================================================================
+// StatisticsViewer
+//==============================================================================
+//
+
+StatisticsViewer::StatisticsViewer(RetDec& p)
+		: plg(p)
+{
+
+}
+
+StatisticsViewer::~StatisticsViewer()
+{
+	if (_timer)
+	{
+		unregister_timer(_timer);
+	}
+	// The viewer points to our lines.
+	if (isOpen())
+	{
+		close_widget(_widget, 0);
+	}
+	if (_widget)
+	{
+		Profiler::setEnabled(_profilerWasEnabled);
+	}
+}
+
+void StatisticsViewer::open()
+{
+	if (isOpen())
+	{
+		bool take_focus = true;
+		activate_widget(_widget, take_focus);
+		return;
+	}
+
+	// The viewer may have been closed without the timer noticing it yet,
+	// the profiler is then still enabled by us.
+	if (_widget == nullptr)
+	{
+		_profilerWasEnabled = Profiler::enabled();
+	}
+	Profiler::setEnabled(true);
+	update();
+
+	simpleline_place_t min(0);
+	simpleline_place_t max(_lines.size() - 1);
+	_widget = create_custom_viewer(
+			title,        // title
+			&min,         // minplace
+			&max,         // maxplace
+			&min,         // curplace
+			nullptr,      // rinfo
+			&_lines,      // ud
+			nullptr,      // handlers
+			nullptr,      // cvhandlers_ud
+			nullptr       // parent widget
+	);
+
+	// Next to the decompiled code if it is shown.
+	if (plg.codeViewer)
+	{
+		display_widget(
+				_widget,
+				WOPN_DP_RIGHT | WOPN_RESTORE,
+				RetDec::pluginName.c_str()
+		);
+	}
+	else
+	{
+		display_widget(_widget, WOPN_DP_TAB | WOPN_RESTORE);
+	}
+
+	if (_timer == nullptr)
+	{
+		_timer = register_timer(_period, timer, this);
+	}
+}
+
+bool StatisticsViewer::isOpen() const
+{
+	// The widget is destroyed when the user closes it.
+	return _widget != nullptr && find_widget(title) == _widget;
+}
+
+/**
+ * Called periodically on the UI thread. Returns the next period, or -1 which
+ * unregisters the timer once the viewer is closed.
+ */
+int idaapi StatisticsViewer::timer(void* ud)
+{
+	auto* v = static_cast<StatisticsViewer*>(ud);
+	if (!v->isOpen())
+	{
+		Profiler::setEnabled(v->_profilerWasEnabled);
+		v->_widget = nullptr;
+		v->_timer = nullptr;
+		return -1;
+	}
+
+	v->update();
+	simpleline_place_t min(0);
+	simpleline_place_t max(v->_lines.size() - 1);
+	set_custom_viewer_range(v->_widget, &min, &max);
+	refresh_custom_viewer(v->_widget);
+	repaint_custom_viewer(v->_widget);
+	return _period;
+}
+
+void StatisticsViewer::update()
+{
+	std::vector<std::string> lines;
+	auto row = [&lines] (
+			const std::string& name,
+			const std::vector<std::string>& values,
+			unsigned indent = 1)
+	{
+		std::stringstream ss;
+		ss << std::string(4 * indent, ' ')
+				<< std::left << std::setw(40 - 4 * indent) << name
+				<< std::right;
+		for (auto& v : values)
+		{
+			ss << std::setw(12) << v;
+		}
+		lines.push_back(ss.str());
+	};
+	auto num = [] (std::uint64_t n)
+	{
+		return std::to_string(n);
+	};
+	auto kb = [] (std::uint64_t bytes)
+	{
+		return std::to_string(bytes / 1024) + " kB";
+	};
+	auto ms = [] (std::uint64_t us)
+	{
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1) << us / 1000.0;
+		return ss.str();
+	};
+
+	auto& ds = RetDec::decompilationStats;
+	lines.push_back("Decompiler runs");
+	row("runs", {num(ds.runs)});
+	row("decompiled functions", {num(ds.functions)});
+	row("failures", {num(ds.failures)});
+	for (auto& e : ds.errors)
+	{
+		row(e.first, {num(e.second)}, 2);
+	}
+	lines.push_back("");
+
+	auto& fs = RetDec::functionCache.stats();
+	lines.push_back("Decompiled functions in memory");
+	row("functions", {num(fs.functions)});
+	row("memory", {kb(fs.bytes)});
+	row("peak memory", {kb(fs.peakBytes)});
+	row("budget", {RetDec::options.functionCacheSize
+			? num(RetDec::options.functionCacheSize) + " MB"
+			: "unlimited"});
+	row("hits", {num(fs.hits)});
+	row("misses (loaded from IDB)", {num(fs.misses)});
+	row("evictions", {num(fs.evictions)});
+	lines.push_back("");
+
+	lines.push_back("Background decompilation");
+	row("queued jobs", {num(plg.worker.queued())});
+	row("pending functions", {num(plg.worker.pending())});
+	lines.push_back("");
+
+	row("Phases [ms]", {"count", "avg", "p95", "max"}, 0);
+	auto phases = Profiler::aggregates();
+	if (phases.empty())
+	{
+		lines.push_back("    nothing measured yet");
+	}
+	for (auto& p : phases)
+	{
+		auto& a = p.second;
+		row(p.first, {
+				num(a.count),
+				ms(a.wall / a.count),
+				ms(a.percentile(95)),
+				ms(a.maxWall)
+		});
+	}
+
+	// The viewer points to the vector, only its content may change.
+	_lines.clear();
+	for (auto& l : lines)
+	{
+		_lines.push_back(simpleline_t(l.c_str()));
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef RETDEC_STATS_H
+#define RETDEC_STATS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "utils.h"
+
+class RetDec;
+
+/**
+ * Outcomes of the decompiler runs in this session.
+ */
+struct DecompilationStats
+{
+	/// Decompiler runs, and the functions decompiled by them.
+	std::uint64_t runs = 0;
+	std::uint64_t functions = 0;
+	/// Failed decompiler runs, and their numbers by the error (e.g.
+	/// "decompilation error code = 1" from runDecompilation()).
+	std::uint64_t failures = 0;
+	std::map<std::string, std::uint64_t> errors;
+
+	/// Decompiler run finished.
+	/// @param functions Number of the decompiled functions.
+	void finished(
+			bool failed,
+			const std::string& error,
+			std::size_t functions = 1
+	);
+};
+
+/**
+ * Dockable viewer of the session statistics: decompiler runs and their
+ * failures, latencies of the decompilation phases (see Profiler), decompiled
+ * functions in memory (see FunctionCache), and the background decompilation
+ * queue (see Worker). It is refreshed periodically while it is open.
+ *
+ * Phases are measured only while profiling, opening the viewer therefore
+ * enables it until the viewer is closed.
+ */
+class StatisticsViewer
+{
+	public:
+		StatisticsViewer(RetDec& p);
+		~StatisticsViewer();
+
+		/// Open the viewer, or bring it to the front if it is already open.
+		void open();
+
+	private:
+		bool isOpen() const;
+		void update();
+		static int idaapi timer(void* ud);
+
+	public:
+		inline static const char* title = "RetDec statistics";
+
+	private:
+		RetDec& plg;
+		TWidget* _widget = nullptr;
+		qtimer_t _timer = nullptr;
+		/// Profiler::enabled() before the viewer was opened.
+		bool _profilerWasEnabled = false;
+		/// Lines shown by the viewer, it points to them.
+		strvec_t _lines;
+
+		/// Refresh period [ms].
+		inline static const int _period = 1000;
+};
+
+#endif
@@ -0,0 +1,102 @@
+
+#include <cerrno>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#endif
+
+#include "thread.h"
+
+#ifdef _WIN32
+
+static unsigned __stdcall threadEntry(void* fnc)
+{
+	(*static_cast<std::function<void()>*>(fnc))();
+	return 0;
+}
+
+Thread::Thread(std::function<void()> fnc, std::size_t stackSize)
+		: _fnc(std::make_unique<std::function<void()>>(std::move(fnc)))
+{
+	// The size is only reserved, the stack is committed as it grows.
+	auto h = _beginthreadex(
+			nullptr,
+			static_cast<unsigned>(stackSize),
+			threadEntry,
+			_fnc.get(),
+			STACK_SIZE_PARAM_IS_A_RESERVATION,
+			nullptr
+	);
+	if (h == 0)
+	{
+		throw std::system_error(
+				errno,
+				std::generic_category(),
+				"unable to start a thread"
+		);
+	}
+	_handle = reinterpret_cast<void*>(h);
+}
+
+void Thread::join()
+{
+	if (_joined)
+	{
+		return;
+	}
+	WaitForSingleObject(_handle, INFINITE);
+	CloseHandle(_handle);
+	_handle = nullptr;
+	_joined = true;
+}
+
+#else
+
+static void* threadEntry(void* fnc)
+{
+	(*static_cast<std::function<void()>*>(fnc))();
+	return nullptr;
+}
+
+Thread::Thread(std::function<void()> fnc, std::size_t stackSize)
+		: _fnc(std::make_unique<std::function<void()>>(std::move(fnc)))
+{
+	pthread_attr_t attr;
+	int rc = pthread_attr_init(&attr);
+	if (rc == 0)
+	{
+		rc = pthread_attr_setstacksize(&attr, stackSize);
+		if (rc == 0)
+		{
+			rc = pthread_create(&_thread, &attr, threadEntry, _fnc.get());
+		}
+		pthread_attr_destroy(&attr);
+	}
+	if (rc != 0)
+	{
+		throw std::system_error(
+				rc,
+				std::generic_category(),
+				"unable to start a thread"
+		);
+	}
+}
+
+void Thread::join()
+{
+	if (_joined)
+	{
+		return;
+	}
+	pthread_join(_thread, nullptr);
+	_joined = true;
+}
+
+#endif
+
+Thread::~Thread()
+{
+	join();
+}
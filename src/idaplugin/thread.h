@@ -0,0 +1,60 @@
+
+#ifndef RETDEC_THREAD_H
+#define RETDEC_THREAD_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/**
+ * Thread with an explicit stack size.
+ *
+ * std::thread uses the default stack of the platform (1 MB on Windows,
+ * 512 kB for secondary threads on macOS), which is too small for RetDec.
+ * The decompilation worker executable is linked with a 16 MB stack for the
+ * same reason (see src/worker).
+ *
+ * The thread must be joined before the object is destroyed, it is never
+ * detached. Does not use IDA API.
+ */
+class Thread
+{
+	public:
+		/// Stack size of threads running decompilations [B].
+		inline static const std::size_t decompilationStackSize =
+				16 * 1024 * 1024;
+
+	public:
+		/// Start running \p fnc in a new thread.
+		/// Throws std::system_error if the thread can not be started.
+		Thread(
+				std::function<void()> fnc,
+				std::size_t stackSize = decompilationStackSize
+		);
+		/// Joins the thread if it was not joined yet.
+		~Thread();
+
+		Thread(const Thread&) = delete;
+		Thread& operator=(const Thread&) = delete;
+
+		/// Wait until the thread finishes.
+		void join();
+
+	private:
+		/// Owned by the running thread's entry point until it is joined.
+		std::unique_ptr<std::function<void()>> _fnc;
+		bool _joined = false;
+
+#ifdef _WIN32
+		// Windows HANDLE, <windows.h> does not go well with IDA SDK headers.
+		void* _handle = nullptr;
+#else
+		pthread_t _thread;
+#endif
+};
+
+#endif
@@ -1,64 +1,99 @@
 
-#include <map>
+#include <algorithm>
+#include <limits>
+#include <string_view>
 
 #include <lines.hpp>
 #include <pro.h>
 
-#include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
+#include <rapidjson/reader.h>
 
-#include <retdec/common/address.h>
-
+#include "profiler.h"
 #include "token.h"
 
-std::map<Token::Kind, std::string> TokenColors =
-{
-	{Token::Kind::NEW_LINE, SCOLOR_DEFAULT},
-	{Token::Kind::WHITE_SPACE, SCOLOR_DEFAULT},
-	{Token::Kind::PUNCTUATION, SCOLOR_KEYWORD},
-	{Token::Kind::OPERATOR, SCOLOR_KEYWORD},
-	{Token::Kind::ID_GVAR, SCOLOR_DREF},
-	{Token::Kind::ID_LVAR, SCOLOR_DREF},
-	{Token::Kind::ID_MEM, SCOLOR_DREF},
-	{Token::Kind::ID_LAB, SCOLOR_DREF},
-	{Token::Kind::ID_FNC, SCOLOR_DEFAULT},
-	{Token::Kind::ID_ARG, SCOLOR_DREF},
-	{Token::Kind::KEYWORD, SCOLOR_MACRO},
-	{Token::Kind::TYPE, SCOLOR_MACRO},
-	{Token::Kind::PREPROCESSOR, SCOLOR_AUTOCMT},
-	{Token::Kind::INCLUDE, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_BOOL, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_INT, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_FP, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_STR, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_SYM, SCOLOR_NUMBER},
-	{Token::Kind::LITERAL_PTR, SCOLOR_NUMBER},
-	{Token::Kind::COMMENT, SCOLOR_AUTOCMT},
+/**
+ * Tables indexed by Token::Kind.
+ */
+static constexpr std::size_t kindCount =
+		static_cast<std::size_t>(Token::Kind::COMMENT) + 1;
+
+static constexpr const char* tokenColors[kindCount] =
+{
+	SCOLOR_DEFAULT,  // NEW_LINE
+	SCOLOR_DEFAULT,  // WHITE_SPACE
+	SCOLOR_KEYWORD,  // PUNCTUATION
+	SCOLOR_KEYWORD,  // OPERATOR
+	SCOLOR_DREF,     // ID_GVAR
+	SCOLOR_DREF,     // ID_LVAR
+	SCOLOR_DREF,     // ID_MEM
+	SCOLOR_DREF,     // ID_LAB
+	SCOLOR_DEFAULT,  // ID_FNC
+	SCOLOR_DREF,     // ID_ARG
+	SCOLOR_MACRO,    // KEYWORD
+	SCOLOR_MACRO,    // TYPE
+	SCOLOR_AUTOCMT,  // PREPROCESSOR
+	SCOLOR_NUMBER,   // INCLUDE
+	SCOLOR_NUMBER,   // LITERAL_BOOL
+	SCOLOR_NUMBER,   // LITERAL_INT
+	SCOLOR_NUMBER,   // LITERAL_FP
+	SCOLOR_NUMBER,   // LITERAL_STR
+	SCOLOR_NUMBER,   // LITERAL_SYM
+	SCOLOR_NUMBER,   // LITERAL_PTR
+	SCOLOR_AUTOCMT,  // COMMENT
 };
 
-std::map<Token::Kind, std::string> TokenKindStrings =
-{
-	{Token::Kind::NEW_LINE, "NEW_LINE"},
-	{Token::Kind::WHITE_SPACE, "WHITE_SPACE"},
-	{Token::Kind::PUNCTUATION, "PUNCTUATION"},
-	{Token::Kind::OPERATOR, "OPERATOR"},
-	{Token::Kind::ID_GVAR, "ID_GVAR"},
-	{Token::Kind::ID_LVAR, "ID_LVAR"},
-	{Token::Kind::ID_MEM, "ID_MEM"},
-	{Token::Kind::ID_LAB, "ID_LAB"},
-	{Token::Kind::ID_FNC, "ID_FNC"},
-	{Token::Kind::ID_ARG, "ID_ARG"},
-	{Token::Kind::KEYWORD, "KEYWORD"},
-	{Token::Kind::TYPE, "TYPE"},
-	{Token::Kind::PREPROCESSOR, "PREPROCESSOR"},
-	{Token::Kind::INCLUDE, "INCLUDE"},
-	{Token::Kind::LITERAL_BOOL, "LITERAL_BOOL"},
-	{Token::Kind::LITERAL_INT, "LITERAL_INT"},
-	{Token::Kind::LITERAL_FP, "LITERAL_FP"},
-	{Token::Kind::LITERAL_STR, "LITERAL_STR"},
-	{Token::Kind::LITERAL_SYM, "LITERAL_SYM"},
-	{Token::Kind::LITERAL_PTR, "LITERAL_PTR"},
-	{Token::Kind::COMMENT, "COMMENT"},
+static constexpr const char* tokenKindStrings[kindCount] =
+{
+	"NEW_LINE",
+	"WHITE_SPACE",
+	"PUNCTUATION",
+	"OPERATOR",
+	"ID_GVAR",
+	"ID_LVAR",
+	"ID_MEM",
+	"ID_LAB",
+	"ID_FNC",
+	"ID_ARG",
+	"KEYWORD",
+	"TYPE",
+	"PREPROCESSOR",
+	"INCLUDE",
+	"LITERAL_BOOL",
+	"LITERAL_INT",
+	"LITERAL_FP",
+	"LITERAL_STR",
+	"LITERAL_SYM",
+	"LITERAL_PTR",
+	"COMMENT",
+};
+
+/**
+ * Kind names used in RetDec's JSON output.
+ */
+static constexpr std::string_view tokenJsonKinds[kindCount] =
+{
+	"nl",
+	"ws",
+	"punc",
+	"op",
+	"i_gvar",
+	"i_lvar",
+	"i_mem",
+	"i_lab",
+	"i_fnc",
+	"i_arg",
+	"keyw",
+	"type",
+	"preproc",
+	"inc",
+	"l_bool",
+	"l_int",
+	"l_fp",
+	"l_str",
+	"l_sym",
+	"l_ptr",
+	"cmnt",
 };
 
 Token::Token()
@@ -66,96 +101,527 @@ Token::Token()
 
 }
 
-Token::Token(Kind k, ea_t a, const std::string& v)
+Token::Token(Kind k, ea_t a, std::string v)
 		: kind(k)
 		, ea(a)
-		, value(v)
+		, value(std::move(v))
+{
+
+}
+
+const char* Token::getKindString() const
+{
+	return tokenKindStrings[static_cast<std::size_t>(kind)];
+}
+
+const char* Token::getColorTag() const
 {
+	return getColorTag(kind);
+}
+
+const char* Token::getColorTag(Kind k)
+{
+	return tokenColors[static_cast<std::size_t>(k)];
+}
+
+/**
+ * Parse token address.
+ * Same format as retdec::common::Address, i.e. hexadecimal number with "0x"
+ * prefix, or decimal number, but without the intermediate string stream.
+ * Returns \c true if the address is not valid.
+ */
+static bool parseAddress(const char* str, std::size_t len, ea_t& ea)
+{
+	const char* end = str + len;
+	uint64 val = 0;
+	unsigned base = 10;
+	if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+	{
+		base = 16;
+		str += 2;
+	}
+	if (str == end)
+	{
+		return true;
+	}
+
+	for (; str < end; ++str)
+	{
+		unsigned d = 0;
+		char c = *str;
+		if (c >= '0' && c <= '9') d = c - '0';
+		else if (base == 16 && c >= 'a' && c <= 'f') d = c - 'a' + 10;
+		else if (base == 16 && c >= 'A' && c <= 'F') d = c - 'A' + 10;
+		else return true;
+
+		if (val > (std::numeric_limits<uint64>::max() - d) / base)
+		{
+			return true;
+		}
+		val = val * base + d;
+	}
+
+	ea = val;
+	return false;
+}
+
+/**
+ * Returns the only JSON kind that \p k may be, selected by its length and
+ * distinguishing characters. \p k still has to be compared with it.
+ */
+static constexpr Token::Kind kindCandidate(std::string_view k)
+{
+	using K = Token::Kind;
+	switch (k.size())
+	{
+		case 2:
+			switch (k[0])
+			{
+				case 'n': return K::NEW_LINE;
+				case 'w': return K::WHITE_SPACE;
+				case 'o': return K::OPERATOR;
+			}
+			break;
+		case 3:
+			return K::INCLUDE;
+		case 4:
+			switch (k[0])
+			{
+				case 'p': return K::PUNCTUATION;
+				case 'k': return K::KEYWORD;
+				case 't': return K::TYPE;
+				case 'c': return K::COMMENT;
+				case 'l': return K::LITERAL_FP;
+			}
+			break;
+		case 5:
+			switch (k[2])
+			{
+				case 'm': return K::ID_MEM;
+				case 'l': return K::ID_LAB;
+				case 'f': return K::ID_FNC;
+				case 'a': return K::ID_ARG;
+				case 'i': return K::LITERAL_INT;
+				case 'p': return K::LITERAL_PTR;
+				case 's': return k[3] == 't' ? K::LITERAL_STR : K::LITERAL_SYM;
+			}
+			break;
+		case 6:
+			switch (k[2])
+			{
+				case 'g': return K::ID_GVAR;
+				case 'l': return K::ID_LVAR;
+				case 'b': return K::LITERAL_BOOL;
+			}
+			break;
+		case 7:
+			return K::PREPROCESSOR;
+	}
+	// Never matches - the shortest kind is longer than one character.
+	return K::NEW_LINE;
+}
 
+/**
+ * Returns \c true if \p k is not a known token kind.
+ */
+static constexpr bool parseKind(std::string_view k, Token::Kind& kk)
+{
+	Token::Kind c = kindCandidate(k);
+	if (tokenJsonKinds[static_cast<std::size_t>(c)] != k)
+	{
+		return true;
+	}
+	kk = c;
+	return false;
 }
 
-const std::string& Token::getKindString() const
+static constexpr bool checkKindTable()
 {
-	return TokenKindStrings[kind];
+	for (std::size_t i = 0; i < kindCount; ++i)
+	{
+		Token::Kind k = Token::Kind::NEW_LINE;
+		if (parseKind(tokenJsonKinds[i], k)
+				|| static_cast<std::size_t>(k) != i)
+		{
+			return false;
+		}
+	}
+	return true;
 }
+static_assert(checkKindTable(), "kindCandidate() does not match the kinds");
 
-const std::string& Token::getColorTag() const
+bool Token::kindFromJson(std::string_view name, Kind& k)
 {
-	return TokenColors[kind];
+	return parseKind(name, k);
 }
 
+/**
+ * rapidjson SAX handler that turns the "tokens" array of the decompilation
+ * output directly into tokens, without building the whole JSON document.
+ */
+class TokenHandler
+{
+	public:
+		TokenHandler(std::vector<Token>& tokens, ea_t defaultEa)
+				: _tokens(tokens)
+				, _defaultEa(defaultEa)
+				, _ea(defaultEa)
+		{
+
+		}
+
+		/// Was the "tokens" array found?
+		bool foundTokens() const
+		{
+			return _foundTokens;
+		}
+
+		bool Null()                                  { return value(); }
+		bool Bool(bool)                              { return value(); }
+		bool Int(int)                                { return value(); }
+		bool Uint(unsigned)                          { return value(); }
+		bool Int64(int64_t)                          { return value(); }
+		bool Uint64(uint64_t)                        { return value(); }
+		bool Double(double)                          { return value(); }
+		bool RawNumber(const char*, rapidjson::SizeType, bool)
+		{
+			return value();
+		}
+
+		bool String(const char* str, rapidjson::SizeType len, bool)
+		{
+			if (_depth != tokenDepth)
+			{
+				return true;
+			}
+
+			switch (_member)
+			{
+				case Member::ADDR:
+				{
+					ea_t ea = BADADDR;
+					_addr = parseAddress(str, len, ea) ? BADADDR : ea;
+					_hasAddr = true;
+					break;
+				}
+				case Member::KIND:
+					_hasKind = !parseKind(std::string_view(str, len), _kind);
+					break;
+				case Member::VAL:
+					_val.assign(str, len);
+					_hasVal = true;
+					break;
+				case Member::OTHER:
+					break;
+			}
+			return true;
+		}
+
+		bool Key(const char* str, rapidjson::SizeType len, bool)
+		{
+			if (_depth == topDepth)
+			{
+				_topKey.assign(str, len);
+			}
+			else if (_depth == tokenDepth)
+			{
+				std::string_view k(str, len);
+				if (k == "addr") _member = Member::ADDR;
+				else if (k == "kind") _member = Member::KIND;
+				else if (k == "val") _member = Member::VAL;
+				else _member = Member::OTHER;
+			}
+			return true;
+		}
+
+		bool StartObject()
+		{
+			value();
+			if (_depth == arrayDepth && _inTokens)
+			{
+				_hasAddr = _hasKind = _hasVal = false;
+			}
+			++_depth;
+			return true;
+		}
+
+		bool EndObject(rapidjson::SizeType)
+		{
+			--_depth;
+			if (_depth == arrayDepth && _inTokens)
+			{
+				emitToken();
+			}
+			return true;
+		}
+
+		bool StartArray()
+		{
+			value();
+			if (_depth == topDepth && _topKey == "tokens")
+			{
+				_inTokens = true;
+				_foundTokens = true;
+			}
+			++_depth;
+			return true;
+		}
+
+		bool EndArray(rapidjson::SizeType)
+		{
+			--_depth;
+			if (_depth == topDepth)
+			{
+				_inTokens = false;
+			}
+			return true;
+		}
+
+	private:
+		/// Non-string value, or container, of the current token member
+		/// invalidates it.
+		bool value()
+		{
+			if (_depth == tokenDepth)
+			{
+				switch (_member)
+				{
+					case Member::ADDR: _hasAddr = false; break;
+					case Member::KIND: _hasKind = false; break;
+					case Member::VAL: _hasVal = false; break;
+					case Member::OTHER: break;
+				}
+			}
+			return true;
+		}
+
+		void emitToken()
+		{
+			if (_hasAddr)
+			{
+				_ea = _addr != BADADDR ? _addr : _defaultEa;
+			}
+
+			if (_hasKind && _hasVal)
+			{
+				_tokens.emplace_back(_kind, _ea, std::move(_val));
+				_val.clear();
+			}
+		}
+
+	private:
+		/// Depths of the top-level object, the tokens array, and the token
+		/// objects.
+		static const unsigned topDepth = 1;
+		static const unsigned arrayDepth = 2;
+		static const unsigned tokenDepth = 3;
+
+		enum class Member { ADDR, KIND, VAL, OTHER };
+
+		std::vector<Token>& _tokens;
+		ea_t _defaultEa = BADADDR;
+		ea_t _ea = BADADDR;
+
+		unsigned _depth = 0;
+		std::string _topKey;
+		bool _inTokens = false;
+		bool _foundTokens = false;
+
+		/// Members of the currently parsed token object.
+		Member _member = Member::OTHER;
+		bool _hasAddr = false;
+		ea_t _addr = BADADDR;
+		bool _hasKind = false;
+		Token::Kind _kind = Token::Kind::NEW_LINE;
+		bool _hasVal = false;
+		std::string _val;
+};
+
 std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa)
 {
+	Profiler::Phase phase("parse");
 	std::vector<Token> res;
 
+	TokenHandler handler(res, defaultEa);
 	rapidjson::StringStream rss(json.c_str());
-	rapidjson::Document d;
-	rapidjson::ParseResult ok = d.ParseStream(rss);
+	rapidjson::Reader reader;
+	rapidjson::ParseResult ok = reader.Parse(rss, handler);
 	if (!ok)
 	{
 		std::string errMsg = GetParseError_En(ok.Code());
 		WARNING_GUI("Unable to parse decompilation output: "
 				<< errMsg << std::endl
 		);
-		return res;
+		return std::vector<Token>();
 	}
 
-	auto tokens = d.FindMember("tokens");
-	if (tokens == d.MemberEnd() || !tokens->value.IsArray())
+	if (!handler.foundTokens())
 	{
 		WARNING_GUI("Unable to parse tokens from decompilation output.\n");
-		return res;
 	}
 
-	ea_t ea = defaultEa;
+	return res;
+}
+
+namespace {
+
+/**
+ * Start address of the function preceded by the given token, \c BADADDR if
+ * the token is not a function's address range comment.
+ */
+ea_t functionStart(const Token& t)
+{
+	static const std::string prefix = "// Address range: ";
+	if (t.kind != Token::Kind::COMMENT
+			|| t.value.compare(0, prefix.size(), prefix) != 0)
+	{
+		return BADADDR;
+	}
+	try
+	{
+		return std::stoull(t.value.substr(prefix.size()), nullptr, 0);
+	}
+	catch (const std::logic_error&)
+	{
+		return BADADDR;
+	}
+}
+
+bool isSectionComment(const Token& t)
+{
+	return t.kind == Token::Kind::COMMENT
+			&& t.value.compare(0, 5, "// --") == 0;
+}
+
+} // anonymous namespace
+
+std::map<ea_t, std::vector<Token>> splitTokens(const std::vector<Token>& tokens)
+{
+	Profiler::Phase phase("split");
+	// Start addresses of the functions and indexes of their first tokens.
+	std::vector<std::pair<ea_t, std::size_t>> starts;
+	for (std::size_t i = 0; i < tokens.size(); ++i)
+	{
+		ea_t ea = functionStart(tokens[i]);
+		if (ea != BADADDR)
+		{
+			starts.emplace_back(ea, i);
+		}
+	}
+	if (starts.empty())
+	{
+		return {};
+	}
+
+	// The last function ends at the next section.
+	std::size_t prefixEnd = starts.front().second;
+	std::size_t suffixBegin = starts.back().second;
+	while (suffixBegin < tokens.size() && !isSectionComment(tokens[suffixBegin]))
+	{
+		++suffixBegin;
+	}
+
+	std::map<ea_t, std::vector<Token>> ret;
+	for (std::size_t s = 0; s < starts.size(); ++s)
+	{
+		ea_t start = starts[s].first;
+		auto b = starts[s].second;
+		auto e = s + 1 < starts.size() ? starts[s + 1].second : suffixBegin;
+
+		auto& ts = ret[start];
+		ts.reserve(prefixEnd + (e - b) + (tokens.size() - suffixBegin));
+		auto append = [&] (std::size_t from, std::size_t to, bool shared)
+		{
+			for (auto i = from; i < to; ++i)
+			{
+				ts.push_back(tokens[i]);
+				if (shared || ts.back().ea == BADADDR)
+				{
+					ts.back().ea = start;
+				}
+			}
+		};
+		append(0, prefixEnd, true);
+		append(b, e, false);
+		append(suffixBegin, tokens.size(), true);
+	}
+	return ret;
+}
+
+/**
+ * Consecutive tokens usually share the same address, so it is stored only if
+ * it changed. This is signaled by the highest bit in the kind byte.
+ */
+static const uchar newEaFlag = 0x80;
+
+void serializeTokens(bytevec_t* out, const std::vector<Token>& tokens)
+{
+	out->pack_dd(tokens.size());
 
-	for (auto i = tokens->value.Begin(), e = tokens->value.End(); i != e; ++i)
+	ea_t ea = BADADDR;
+	for (auto& t : tokens)
 	{
-		auto& obj = *i;
-		if (obj.IsNull())
+		uchar kind = static_cast<uchar>(t.kind);
+		if (t.ea != ea)
 		{
-			continue;
+			out->pack_db(kind | newEaFlag);
+			out->pack_ea(t.ea);
+			ea = t.ea;
 		}
+		else
+		{
+			out->pack_db(kind);
+		}
+		out->pack_dd(t.value.size());
+		out->append(t.value.data(), t.value.size());
+	}
+}
+
+bool deserializeTokens(
+		const uchar** pptr,
+		const uchar* end,
+		std::vector<Token>& tokens)
+{
+	tokens.clear();
+
+	if (*pptr >= end)
+	{
+		return true;
+	}
+	auto n = unpack_dd(pptr, end);
+	// The count comes from a file, which may be corrupted. Each token takes
+	// at least two bytes (kind and length).
+	tokens.reserve(std::min<std::size_t>(n, (end - *pptr) / 2));
 
-		auto addr = obj.FindMember("addr");
-		if (addr != obj.MemberEnd() && addr->value.IsString())
+	ea_t ea = BADADDR;
+	for (uint32 i = 0; i < n; ++i)
+	{
+		if (*pptr >= end)
+		{
+			return true;
+		}
+
+		uchar kind = unpack_db(pptr, end);
+		if (kind & newEaFlag)
 		{
-			retdec::common::Address a(addr->value.GetString());
-			ea = a.isDefined() ? a.getValue() : defaultEa;
+			ea = unpack_ea(pptr, end);
+			kind &= ~newEaFlag;
 		}
-		auto kind = obj.FindMember("kind");
-		auto val = obj.FindMember("val");
-		if (kind != obj.MemberEnd() && kind->value.IsString()
-				&& val != obj.MemberEnd() && val->value.IsString())
+		if (kind > static_cast<uchar>(Token::Kind::COMMENT))
 		{
-			Token::Kind kk;
-			std::string k = kind->value.GetString();
-			if (k == "nl") kk = Token::Kind::NEW_LINE;
-			else if (k == "ws") kk = Token::Kind::WHITE_SPACE;
-			else if (k == "punc") kk = Token::Kind::PUNCTUATION;
-			else if (k == "op") kk = Token::Kind::OPERATOR;
-			else if (k == "i_gvar") kk = Token::Kind::ID_GVAR;
-			else if (k == "i_lvar") kk = Token::Kind::ID_LVAR;
-			else if (k == "i_mem") kk = Token::Kind::ID_MEM;
-			else if (k == "i_lab") kk = Token::Kind::ID_LAB;
-			else if (k == "i_fnc") kk = Token::Kind::ID_FNC;
-			else if (k == "i_arg") kk = Token::Kind::ID_ARG;
-			else if (k == "keyw") kk = Token::Kind::KEYWORD;
-			else if (k == "type") kk = Token::Kind::TYPE;
-			else if (k == "preproc") kk = Token::Kind::PREPROCESSOR;
-			else if (k == "inc") kk = Token::Kind::INCLUDE;
-			else if (k == "l_bool") kk = Token::Kind::LITERAL_BOOL;
-			else if (k == "l_int") kk = Token::Kind::LITERAL_INT;
-			else if (k == "l_fp") kk = Token::Kind::LITERAL_FP;
-			else if (k == "l_str") kk = Token::Kind::LITERAL_STR;
-			else if (k == "l_sym") kk = Token::Kind::LITERAL_SYM;
-			else if (k == "l_ptr") kk = Token::Kind::LITERAL_PTR;
-			else if (k == "cmnt") kk = Token::Kind::COMMENT;
-			else continue;
+			return true;
+		}
 
-			res.emplace_back(Token(kk, ea, val->value.GetString()));
+		std::size_t len = unpack_dd(pptr, end);
+		if (std::size_t(end - *pptr) < len)
+		{
+			return true;
 		}
+		std::string val(reinterpret_cast<const char*>(*pptr), len);
+		*pptr += len;
+
+		tokens.emplace_back(Token(static_cast<Token::Kind>(kind), ea, val));
 	}
 
-	return res;
+	return false;
 }
@@ -2,7 +2,10 @@
 #ifndef RETDEC_TOKEN_H
 #define RETDEC_TOKEN_H
 
+#include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "utils.h"
 
@@ -44,12 +47,48 @@ struct Token
 	std::string value;
 
 	Token();
-	Token(Kind k, ea_t a, const std::string& v);
+	Token(Kind k, ea_t a, std::string v);
 
-	const std::string& getKindString() const;
-	const std::string& getColorTag() const;
+	const char* getKindString() const;
+	/// One of IDA's SCOLOR_* tags.
+	const char* getColorTag() const;
+	static const char* getColorTag(Kind k);
+
+	/// Kind from its name in RetDec's JSON output.
+	/// Returns \c true if \p name is not a known kind.
+	static bool kindFromJson(std::string_view name, Kind& k);
 };
 
+/**
+ * Parse tokens from RetDec's JSON output.
+ * Tokens without address get the address of the previous token, or
+ * \p defaultEa.
+ */
 std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa);
 
+/**
+ * Split tokens of a decompilation output with multiple functions into
+ * outputs of the individual functions, indexed by their start addresses
+ * (taken from the "// Address range:" comments preceding the functions).
+ * Each output consists of the declarations preceding the first function,
+ * the function itself, and the meta-information following the last function.
+ * Tokens of the shared parts and tokens without address get the start
+ * address of the function.
+ */
+std::map<ea_t, std::vector<Token>> splitTokens(const std::vector<Token>& tokens);
+
+/**
+ * Compact binary form of the tokens, e.g. for storing them in IDB.
+ */
+void serializeTokens(bytevec_t* out, const std::vector<Token>& tokens);
+/**
+ * Inverse of serializeTokens().
+ * Returns \c true if something went wrong.
+ */
+bool deserializeTokens(
+		const uchar** pptr,
+		const uchar* end,
+		std::vector<Token>& tokens
+);
+
 #endif
@@ -1,5 +1,4 @@
 
-#include "config.h"
 #include "place.h"
 #include "retdec.h"
 #include "ui.h"
@@ -27,6 +26,63 @@ action_state_t idaapi fullDecompilation_ah_t::update(action_update_ctx_t*)
 	return AST_ENABLE_ALWAYS;
 }
 
+//
+//==============================================================================
+// batchDecompilation_ah_t
+//==============================================================================
+//
+
+batchDecompilation_ah_t::batchDecompilation_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi batchDecompilation_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	// Rows of the Functions window are the functions in the address order.
+	std::vector<func_t*> fncs;
+	for (auto n : ctx->chooser_selection)
+	{
+		if (func_t* f = getn_func(n))
+		{
+			fncs.push_back(f);
+		}
+	}
+	plg.batchDecompilation(fncs, false);
+	return false;
+}
+
+action_state_t idaapi batchDecompilation_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget_type == BWN_FUNCS
+			? AST_ENABLE_FOR_WIDGET
+			: AST_DISABLE_FOR_WIDGET;
+}
+
+//
+//==============================================================================
+// showStatistics_ah_t
+//==============================================================================
+//
+
+showStatistics_ah_t::showStatistics_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi showStatistics_ah_t::activate(action_activation_ctx_t*)
+{
+	plg.statisticsViewer.open();
+	return false;
+}
+
+action_state_t idaapi showStatistics_ah_t::update(action_update_ctx_t*)
+{
+	return AST_ENABLE_ALWAYS;
+}
+
 //
 //==============================================================================
 // jump2asm_ah_t
@@ -81,7 +137,7 @@ int idaapi copy2asm_ah_t::activate(action_activation_ctx_t*)
 			"Do you want to continue?";
 	if (ask_yn(ASKBTN_NO, text) == ASKBTN_YES)
 	{
-		for (auto& p : plg.fnc->toLines())
+		for (auto& p : RetDec::functionCache.touch(plg.fnc)->toLines())
 		{
 			ea_t addr = p.second;
 			auto& line = p.first;
@@ -176,8 +232,8 @@ int idaapi renameGlobalObj_ah_t::activate(action_activation_ctx_t* ctx)
 			nullptr, // x
 			nullptr // y
 	));
-	auto* token = place ? place->token() : nullptr;
-	if (token == nullptr)
+	auto token = place ? place->token() : std::nullopt;
+	if (!token)
 	{
 		return false;
 	}
@@ -216,9 +272,9 @@ int idaapi renameGlobalObj_ah_t::activate(action_activation_ctx_t* ctx)
 		return false;
 	}
 
+	// Config is updated by the rename IDB event.
 	std::string oldName = token->value;
 	plg.modifyFunctions(token->kind, oldName, newName);
-	fillConfig(plg.config);
 
 	return false;
 }
@@ -249,8 +305,8 @@ int idaapi openXrefs_ah_t::activate(action_activation_ctx_t* ctx)
 			nullptr, // x
 			nullptr // y
 	));
-	auto* token = place ? place->token() : nullptr;
-	if (token == nullptr)
+	auto token = place ? place->token() : std::nullopt;
+	if (!token)
 	{
 		return false;
 	}
@@ -299,8 +355,8 @@ int idaapi openCalls_ah_t::activate(action_activation_ctx_t* ctx)
 			nullptr, // x
 			nullptr // y
 	));
-	auto* token = place ? place->token() : nullptr;
-	if (token == nullptr)
+	auto token = place ? place->token() : std::nullopt;
+	if (!token)
 	{
 		return false;
 	}
@@ -349,8 +405,8 @@ int idaapi changeFuncType_ah_t::activate(action_activation_ctx_t* ctx)
 			nullptr, // x
 			nullptr // y
 	));
-	auto* token = place ? place->token() : nullptr;
-	if (token == nullptr)
+	auto token = place ? place->token() : std::nullopt;
+	if (!token)
 	{
 		return false;
 	}
@@ -422,9 +478,19 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 		// We can attach action to popup - i.e. create menu on the fly.
 		case ui_populating_widget_popup:
 		{
-			// Continue only if event was triggered in our widget.
 			TWidget* view = va_arg(va, TWidget*);
 			TPopupMenu* popup = va_arg(va, TPopupMenu*);
+			if (get_widget_type(view) == BWN_FUNCS)
+			{
+				attach_action_to_popup(
+						view,
+						popup,
+						batchDecompilation_ah_t::actionName
+				);
+				return false;
+			}
+
+			// Continue only if event was triggered in our widget.
 			if (view != custViewer && view != codeViewer)
 			{
 				return false;
@@ -441,8 +507,8 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 				return false;
 			}
 
-			auto* token = place->token();
-			if (token == nullptr)
+			auto token = place->token();
+			if (!token)
 			{
 				return false;
 			}
@@ -531,7 +597,12 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 			{
 				return false;
 			}
-			auto eas = demoPlace->fnc()->yx_2_eas(demoPlace->yx());
+			auto* fnc = demoPlace->fnc();
+			if (fnc == nullptr)
+			{
+				return false;
+			}
+			auto eas = fnc->yx_2_eas(demoPlace->yx());
 
 			lines_rendering_output_t* out = va_arg(va, lines_rendering_output_t*);
 			TWidget* view = va_arg(va, TWidget*);
@@ -597,6 +668,10 @@ void idaapi cv_adjust_place(TWidget* v, lochist_entry_t* loc, void* ud)
 {
 	auto* plc = static_cast<retdec_place_t*>(loc->place());
 	auto* fnc = plc->fnc();
+	if (fnc == nullptr)
+	{
+		return;
+	}
 
 	retdec_place_t nplc(
 			fnc,
@@ -625,8 +700,8 @@ bool idaapi cv_double(TWidget* cv, int shift, void* ud)
 		return false;
 	}
 
-	auto* token = place->token();
-	if (token == nullptr || token->kind != Token::Kind::ID_FNC)
+	auto token = place->token();
+	if (!token || token->kind != Token::Kind::ID_FNC)
 	{
 		return false;
 	}
@@ -663,12 +738,13 @@ void idaapi cv_location_changed(
 		return;
 	}
 
-	if (oldp->fnc() != newp->fnc())
+	auto* fnc = newp->fnc();
+	if (fnc && oldp->fnc() != fnc)
 	{
-		retdec_place_t min(newp->fnc(), newp->fnc()->min_yx());
-		retdec_place_t max(newp->fnc(), newp->fnc()->max_yx());
+		retdec_place_t min(fnc, fnc->min_yx());
+		retdec_place_t max(fnc, fnc->max_yx());
 		set_custom_viewer_range(ctx->custViewer, &min, &max);
-		ctx->fnc = newp->fnc();
+		ctx->fnc = fnc;
 	}
 }
 
@@ -19,6 +19,32 @@ struct fullDecompilation_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct batchDecompilation_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ActionBatchDecompilation";
+	inline static const char* actionLabel = "Decompile selected functions RetDec";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	batchDecompilation_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
+struct showStatistics_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ActionShowStatistics";
+	inline static const char* actionLabel = "RetDec statistics";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	showStatistics_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 struct jump2asm_ah_t : public action_handler_t
 {
 	inline static const char* actionName = "retdec:ActionJump2Asm";
@@ -122,6 +122,23 @@ std::string getInputPath()
 	return inPath;
 }
 
+std::vector<std::string> splitString(
+		const std::string& str,
+		const std::string& separators)
+{
+	std::vector<std::string> ret;
+
+	std::size_t pos = str.find_first_not_of(separators);
+	while (pos != std::string::npos)
+	{
+		auto end = str.find_first_of(separators, pos);
+		ret.push_back(str.substr(pos, end - pos));
+		pos = str.find_first_not_of(separators, end);
+	}
+
+	return ret;
+}
+
 void saveIdaDatabase(bool inSitu, const std::string& suffix)
 {
 	INFO_MSG("Saving IDA database ...\n");
@@ -4,6 +4,7 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 // IDA SDK includes.
 //
@@ -12,6 +13,7 @@
 #include <bytes.hpp>
 #include <demangle.hpp>
 #include <diskio.hpp>
+#include <expr.hpp>
 #include <frame.hpp>
 #include <funcs.hpp>
 #include <idp.hpp>
@@ -90,6 +92,14 @@ bool isX86();
  */
 std::string getInputPath();
 
+/**
+ * Split the string at any of the given separators, empty items are skipped.
+ */
+std::vector<std::string> splitString(
+		const std::string& str,
+		const std::string& separators
+);
+
 /**
  * Save IDA DB before decompilation to protect it if something goes wrong.
  * @param inSitu If true, DB is saved with the default IDA name.
@@ -0,0 +1,363 @@
+
+#include <algorithm>
+
+#include "profiler.h"
+#include "worker.h"
+
+//
+//==============================================================================
+// DecompilationJob
+//==============================================================================
+//
+
+AddressRanges DecompilationJob::ranges() const
+{
+	if (batch.empty())
+	{
+		return {{fncStart, fncEnd}};
+	}
+	return batch;
+}
+
+std::string DecompilationJob::name() const
+{
+	if (batch.empty())
+	{
+		return name(fncStart);
+	}
+	std::stringstream ss;
+	ss << "batch of " << batch.size() << " functions @ " << name(fncStart);
+	return ss.str();
+}
+
+std::string DecompilationJob::name(ea_t fncStart)
+{
+	std::stringstream ss;
+	ss << std::hex << std::showbase << fncStart;
+	return ss.str();
+}
+
+//
+//==============================================================================
+// Worker::deliver_req_t
+//==============================================================================
+//
+
+Worker::deliver_req_t::deliver_req_t(Worker& w)
+		: worker(w)
+{
+
+}
+
+ssize_t idaapi Worker::deliver_req_t::execute()
+{
+	worker.deliver();
+	return 0;
+}
+
+//
+//==============================================================================
+// Worker
+//==============================================================================
+//
+
+Worker::Worker(Callback cb)
+		: _callback(cb)
+{
+
+}
+
+void Worker::start(
+		unsigned threads,
+		const std::string& process,
+		std::uint64_t memoryLimit,
+		std::uint64_t timeout)
+{
+	for (unsigned i = 0; i < std::max(threads, 1u); ++i)
+	{
+		std::shared_ptr<WorkerProcess> p;
+		if (!process.empty())
+		{
+			p = std::make_shared<WorkerProcess>(
+					process,
+					memoryLimit,
+					timeout
+			);
+			std::lock_guard<std::mutex> lock(_state->mutex);
+			_state->processes.push_back(p.get());
+		}
+		_threads.push_back(std::make_unique<Thread>([this, p] ()
+		{
+			loop(_state, p);
+		}));
+	}
+}
+
+Worker::~Worker()
+{
+	bool running = false;
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		_state->stop = true;
+		for (auto& q : _state->jobs)
+		{
+			q.clear();
+		}
+		// Processes are owned by the threads, which are still waiting for
+		// them.
+		for (auto* p : _state->processes)
+		{
+			p->terminate();
+		}
+		running = _state->running > 0;
+		if (_state->request >= 0)
+		{
+			cancel_exec_request(_state->request);
+		}
+	}
+	_state->cv.notify_all();
+
+	// Decompilation in this process can not be interrupted. It must finish
+	// before the plugin (and RetDec linked into it) is unloaded, the thread
+	// then drops the result.
+	if (running)
+	{
+		show_wait_box(
+				"HIDECANCEL\n"
+				"Waiting for the running decompilation to finish..."
+		);
+	}
+	for (auto& t : _threads)
+	{
+		t->join();
+	}
+	if (running)
+	{
+		hide_wait_box();
+	}
+}
+
+std::deque<DecompilationJob>::iterator Worker::findQueued(
+		ea_t fncStart,
+		std::size_t& queue)
+{
+	for (queue = 0; queue < DecompilationJob::priorityCount; ++queue)
+	{
+		auto& q = _state->jobs[queue];
+		auto it = std::find_if(q.begin(), q.end(), [fncStart](auto& j)
+		{
+			return j.fncStart == fncStart;
+		});
+		if (it != q.end())
+		{
+			return it;
+		}
+	}
+	return _state->jobs[0].end();
+}
+
+bool Worker::submit(DecompilationJob&& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		if (_state->stop)
+		{
+			return false;
+		}
+		if (_state->pending.count(job.fncStart))
+		{
+			std::size_t q = 0;
+			auto it = findQueued(job.fncStart, q);
+			if (q < DecompilationJob::priorityCount
+					&& static_cast<std::size_t>(job.priority) < q)
+			{
+				_state->jobs[q].erase(it);
+				_state->jobs[static_cast<std::size_t>(job.priority)].emplace_back(
+						std::move(job)
+				);
+			}
+			return false;
+		}
+		for (auto& r : job.ranges())
+		{
+			_state->pending.insert(r.first);
+		}
+		auto q = static_cast<std::size_t>(job.priority);
+		_state->jobs[q].emplace_back(std::move(job));
+	}
+	_state->cv.notify_one();
+	return true;
+}
+
+bool Worker::isPending(ea_t fncStart) const
+{
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	return _state->pending.count(fncStart);
+}
+
+std::size_t Worker::queued() const
+{
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	std::size_t ret = 0;
+	for (auto& q : _state->jobs)
+	{
+		ret += q.size();
+	}
+	return ret;
+}
+
+std::size_t Worker::pending() const
+{
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	return _state->pending.size();
+}
+
+void Worker::prioritize(ea_t fncStart, Priority priority)
+{
+	std::lock_guard<std::mutex> lock(_state->mutex);
+
+	std::size_t q = 0;
+	auto it = findQueued(fncStart, q);
+	auto p = static_cast<std::size_t>(priority);
+	if (q < DecompilationJob::priorityCount && p < q)
+	{
+		it->priority = priority;
+		_state->jobs[p].emplace_back(std::move(*it));
+		_state->jobs[q].erase(it);
+	}
+}
+
+std::vector<ea_t> Worker::cancel(Priority priority, ea_t keep)
+{
+	std::vector<ea_t> ret;
+
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	auto& q = _state->jobs[static_cast<std::size_t>(priority)];
+	for (auto it = q.begin(); it != q.end();)
+	{
+		if (it->fncStart == keep || !it->batch.empty())
+		{
+			++it;
+			continue;
+		}
+		ret.push_back(it->fncStart);
+		_state->pending.erase(it->fncStart);
+		it = q.erase(it);
+	}
+
+	return ret;
+}
+
+/**
+ * Uses the worker (\c this) only while holding the lock and not stopped, it
+ * may be destroyed while a job is running.
+ */
+void Worker::loop(
+		std::shared_ptr<State> state,
+		std::shared_ptr<WorkerProcess> process)
+{
+	while (true)
+	{
+		DecompilationJob job;
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			auto next = [&state] () -> std::deque<DecompilationJob>*
+			{
+				for (auto& q : state->jobs)
+				{
+					if (!q.empty())
+					{
+						return &q;
+					}
+				}
+				return nullptr;
+			};
+			state->cv.wait(lock, [&] { return state->stop || next(); });
+			if (state->stop)
+			{
+				return;
+			}
+			auto* q = next();
+			job = std::move(q->front());
+			q->pop_front();
+			if (process == nullptr)
+			{
+				++state->running;
+			}
+		}
+
+		run(job, process.get());
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		if (process == nullptr)
+		{
+			--state->running;
+		}
+		if (state->stop)
+		{
+			return;
+		}
+		state->done.emplace_back(std::move(job));
+
+		// One posted request delivers all the finished jobs.
+		// The request is owned by the kernel from now on. We must not wait
+		// for it, UI thread may be waiting for us in the destructor.
+		if (state->request < 0)
+		{
+			state->request = execute_sync(
+					*new deliver_req_t(*this),
+					MFF_WRITE | MFF_NOWAIT
+			);
+		}
+	}
+}
+
+void Worker::run(DecompilationJob& job, WorkerProcess* process)
+{
+	Profiler::Decompilation profile(job.name());
+	if (process)
+	{
+		Profiler::Phase phase("decompile.process");
+		job.failed = process->decompile(
+				*job.config,
+				job.configGeneration,
+				job.ranges(),
+				job.output,
+				job.error
+		);
+		phase.setPeakRss(process->peakRss());
+	}
+	else
+	{
+		Profiler::Phase phase("decompile");
+		auto config = *job.config;
+		config.parameters.setOutputFormat("json");
+		selectRanges(config, job.ranges());
+		job.failed = runDecompilation(config, &job.output, job.error);
+	}
+}
+
+/**
+ * Runs on the UI thread.
+ */
+void Worker::deliver()
+{
+	std::deque<DecompilationJob> done;
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		done.swap(_state->done);
+		for (auto& j : done)
+		{
+			for (auto& r : j.ranges())
+			{
+				_state->pending.erase(r.first);
+			}
+		}
+		_state->request = -1;
+	}
+
+	for (auto& j : done)
+	{
+		_callback(j);
+	}
+}
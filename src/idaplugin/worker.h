@@ -0,0 +1,184 @@
+#ifndef RETDEC_WORKER_H
+#define RETDEC_WORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "decompilation.h"
+#include "process.h"
+#include "thread.h"
+#include "utils.h"
+
+/**
+ * Decompilation of a single function, or of a batch of functions in a single
+ * decompiler run, done by the worker.
+ */
+struct DecompilationJob
+{
+	/// Queued jobs with higher priority (lower value) are run first.
+	enum class Priority
+	{
+		/// Function the user asked for.
+		INTERACTIVE = 0,
+		/// Function the user did not ask for, but will probably need
+		/// (see RetDec::prefetch()).
+		BACKGROUND,
+	};
+	inline static const std::size_t priorityCount =
+			static_cast<std::size_t>(Priority::BACKGROUND) + 1;
+
+	Priority priority = Priority::INTERACTIVE;
+	/// Start of the decompiled function.
+	ea_t fncStart = BADADDR;
+	/// End of the decompiled function.
+	ea_t fncEnd = BADADDR;
+	/// All the functions of a batch (see RetDec::batchDecompilation()),
+	/// including the one above. Empty if the job decompiles only one
+	/// function.
+	AddressRanges batch;
+	/// Address the user asked for - used to position the viewer.
+	ea_t ea = BADADDR;
+	/// Config of the whole input, shared by the jobs created from the same
+	/// config generation. Function selection is applied by the worker.
+	std::shared_ptr<const retdec::config::Config> config;
+	/// IncrementalConfig::generation() of the config, 0 if unknown.
+	std::uint64_t configGeneration = 0;
+	/// Key in the shared decompilation cache, empty if not used.
+	std::string cacheKey;
+
+	/// Filled by the worker thread.
+	bool failed = false;
+	std::string error;
+	std::string output;
+
+	/// Functions decompiled by the job.
+	AddressRanges ranges() const;
+	/// Name of the job in profiles (see Profiler).
+	std::string name() const;
+	/// Name of decompilation of the function starting at the given address
+	/// in profiles.
+	static std::string name(ea_t fncStart);
+};
+
+/**
+ * Background decompilation scheduler.
+ *
+ * Jobs are prepared on the UI thread (config generation needs IDA API),
+ * decompiled on worker threads, and handed back to the UI thread through
+ * execute_sync() where the callback may use IDA API again.
+ *
+ * Each worker thread either decompiles in this process, or drives its own
+ * decompilation worker process (see WorkerProcess). Only the latter can run
+ * multiple decompilations at the same time.
+ *
+ * There is at most one job per function. Queued jobs are run by priority,
+ * in the order of submission within the same priority, and may be cancelled
+ * until they start, except batches which the user asked for explicitly.
+ * Running jobs can not be interrupted, except by killing their worker
+ * process. Destroying the worker therefore waits for the jobs running in
+ * this process. Worker threads have a stack large enough for decompilation
+ * (see Thread).
+ */
+class Worker
+{
+	public:
+		using Callback = std::function<void(DecompilationJob&)>;
+		using Priority = DecompilationJob::Priority;
+
+	public:
+		Worker(Callback cb);
+		~Worker();
+
+		/// Start decompiling the queued jobs.
+		/// @param threads     Maximum number of concurrently running jobs.
+		/// @param process     Decompilation worker executable. If empty,
+		///                    jobs are decompiled in this process.
+		/// @param memoryLimit Memory limit of worker processes [B].
+		/// @param timeout     Time limit of one job in a worker process [s],
+		///                    0 = no limit. Jobs decompiled in this process
+		///                    are not limited.
+		void start(
+				unsigned threads,
+				const std::string& process = std::string(),
+				std::uint64_t memoryLimit = 0,
+				std::uint64_t timeout = 0
+		);
+
+		/// Queue a job. Returns \c false if the function is already queued
+		/// or being decompiled. Queued job gets the higher of the two
+		/// priorities. Functions of a batch must not be pending.
+		bool submit(DecompilationJob&& job);
+		/// Is function starting at the given address queued or being
+		/// decompiled?
+		bool isPending(ea_t fncStart) const;
+		/// Number of the queued jobs.
+		std::size_t queued() const;
+		/// Number of the functions queued or being decompiled.
+		std::size_t pending() const;
+		/// Raise priority of the queued job for the given function.
+		void prioritize(ea_t fncStart, Priority priority);
+		/// Remove all the queued jobs with the given priority, except the one
+		/// for \p keep function and batches. Returns starts of the cancelled
+		/// functions.
+		std::vector<ea_t> cancel(Priority priority, ea_t keep = BADADDR);
+
+		/// Decompile the job right away in the calling thread, either in
+		/// this process or in the given worker process. Does not touch IDA
+		/// API.
+		static void run(DecompilationJob& job, WorkerProcess* process);
+
+	private:
+		/// State shared with the worker threads.
+		struct State
+		{
+			std::mutex mutex;
+			std::condition_variable cv;
+			/// Queued jobs, indexed by priority.
+			std::deque<DecompilationJob> jobs[DecompilationJob::priorityCount];
+			std::deque<DecompilationJob> done;
+			/// Functions with queued or running jobs.
+			std::set<ea_t> pending;
+			/// ID of the posted deliver request (if any) - it must be
+			/// cancelled if the worker dies before it is executed.
+			int request = -1;
+			bool stop = false;
+			/// Jobs being decompiled in this process.
+			unsigned running = 0;
+			/// Worker processes of the threads, killed when stopping.
+			std::vector<WorkerProcess*> processes;
+		};
+
+		void loop(
+				std::shared_ptr<State> state,
+				std::shared_ptr<WorkerProcess> process
+		);
+		void deliver();
+		std::deque<DecompilationJob>::iterator findQueued(
+				ea_t fncStart,
+				std::size_t& queue
+		);
+
+	private:
+		/// execute_sync() request delivering finished jobs to the UI thread.
+		struct deliver_req_t : public exec_request_t
+		{
+			Worker& worker;
+			deliver_req_t(Worker& w);
+			virtual ssize_t idaapi execute() override;
+		};
+
+	private:
+		Callback _callback;
+		std::shared_ptr<State> _state = std::make_shared<State>();
+		std::vector<std::unique_ptr<Thread>> _threads;
+};
+
+#endif
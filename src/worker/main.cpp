@@ -0,0 +1,190 @@
+/**
+ * Decompilation worker process.
+ *
+ * Runs decompilations requested by the plugin (see WorkerProcess and the
+ * protocol in decompilation.h), so that a crash or memory blow-up of the
+ * decompiler does not take IDA down with it. The config of the decompiled
+ * input is kept between requests, see the protocol.
+ *
+ * Usage: retdec-idaplugin-worker [--max-memory <bytes>]
+ * Without --max-memory, memory is limited to half of the system memory.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include <retdec/utils/memory.h>
+
+#include "idaplugin/decompilation.h"
+#include "idaplugin/profiler.h"
+
+namespace {
+
+bool readAll(std::FILE* in, char* data, std::size_t size)
+{
+	return std::fread(data, 1, size, in) != size;
+}
+
+bool writeAll(std::FILE* out, const char* data, std::size_t size)
+{
+	return std::fwrite(data, 1, size, out) != size;
+}
+
+bool readRequest(std::FILE* in, std::string& request)
+{
+	char buff[protocol::sizeLength];
+	if (readAll(in, buff, sizeof(buff)))
+	{
+		return true;
+	}
+	std::uint64_t n = protocol::decodeSize(buff);
+	if (n == 0 || n > protocol::maxPayloadSize)
+	{
+		return true;
+	}
+	request.assign(n, '\0');
+	return readAll(in, &request[0], request.size());
+}
+
+bool writeResponse(std::FILE* out, char status, const std::string& payload)
+{
+	std::string rss = protocol::encodeSize(Profiler::peakRss());
+	std::string size = protocol::encodeSize(
+			1 + rss.size() + payload.size()
+	);
+	bool failed = writeAll(out, size.data(), size.size())
+			|| writeAll(out, &status, 1)
+			|| writeAll(out, rss.data(), rss.size())
+			|| writeAll(out, payload.data(), payload.size());
+	return std::fflush(out) != 0 || failed;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	// Same default as in RetDec's decompiler.
+	std::size_t limit = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc)
+		{
+			limit = std::stoull(argv[++i]);
+		}
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--max-memory <bytes>]\n";
+			return 1;
+		}
+	}
+	bool limited = limit
+			? retdec::utils::limitSystemMemory(limit)
+			: retdec::utils::limitSystemMemoryToHalfOfTotalSystemMemory();
+	if (!limited)
+	{
+		std::cerr << "Warning: failed to limit memory of the worker\n";
+	}
+
+	// The decompiler may print to the standard output, which would break the
+	// protocol. Responses go to a duplicate of the original standard output,
+	// the standard output itself is redirected to the standard error.
+	int outFd = dup(fileno(stdout));
+	dup2(fileno(stderr), fileno(stdout));
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(outFd, _O_BINARY);
+#endif
+	std::FILE* in = stdin;
+	std::FILE* out = fdopen(outFd, "wb");
+	if (out == nullptr)
+	{
+		return 1;
+	}
+
+	// Config of the whole input, kept between decompilations of its
+	// functions.
+	std::unique_ptr<retdec::config::Config> session;
+
+	std::string request;
+	while (!readRequest(in, request))
+	{
+		std::string output;
+		std::string error;
+		bool failed = false;
+		if (request[0] == protocol::requestConfig)
+		{
+			session.reset();
+			try
+			{
+				request.erase(0, 1);
+				session = std::make_unique<retdec::config::Config>(
+						retdec::config::Config::fromJsonString(request)
+				);
+			}
+			catch (const std::exception& e)
+			{
+				failed = true;
+				error = std::string("invalid decompilation config: ")
+						+ e.what();
+			}
+		}
+		else if (request[0] == protocol::requestDecompile
+				&& (request.size() - 1) % (2 * protocol::sizeLength) == 0)
+		{
+			if (session)
+			{
+				AddressRanges ranges;
+				for (std::size_t i = 1; i < request.size();
+						i += 2 * protocol::sizeLength)
+				{
+					ranges.emplace_back(
+							protocol::decodeSize(&request[i]),
+							protocol::decodeSize(
+									&request[i + protocol::sizeLength]
+							)
+					);
+				}
+				auto config = *session;
+				if (!ranges.empty())
+				{
+					selectRanges(config, ranges);
+				}
+				failed = runDecompilation(config, &output, error);
+			}
+			else
+			{
+				failed = true;
+				error = "no decompilation config";
+			}
+		}
+		else
+		{
+			failed = true;
+			error = "invalid request";
+		}
+
+		if (writeResponse(
+				out,
+				failed ? protocol::responseError : protocol::responseOk,
+				failed ? error : output))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}